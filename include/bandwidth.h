@@ -0,0 +1,70 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <utility>
+
+// packets arriving within this long of a group's first packet belong to the same burst
+constexpr std::chrono::milliseconds bandwidthBurst = std::chrono::milliseconds(5);
+// how often the estimate is sent upstream when it is not falling
+constexpr std::chrono::milliseconds bandwidthFeedbackInterval = std::chrono::milliseconds(1000);
+// window the incoming bitrate is measured over
+constexpr std::chrono::milliseconds bandwidthRateWindow = std::chrono::milliseconds(500);
+
+// Receiver side delay gradient bandwidth estimator after Google Congestion Control.
+// Packets are grouped into send bursts by arrival time. The server sends one burst
+// per frame at a fixed rate, so the expected spacing between groups is learned as the
+// long run mean and the difference to it accumulates into a queueing delay estimate.
+// A trendline over that delay is compared against an adaptive threshold; overuse
+// cuts the estimate below the incoming rate, otherwise it grows by 8% per second.
+class BandwidthEstimator {
+public:
+    using clock = std::chrono::steady_clock;
+
+    enum usage { NORMAL, OVERUSE, UNDERUSE };
+
+    void packetReceived(clock::time_point arrival, int bytes);
+    // bits per second, 0 until enough traffic has been seen
+    double estimate() const { return rate; }
+    usage state() const { return detected; }
+    // true when the estimate should be sent upstream, either on the interval or right after a decrease
+    bool feedbackDue(clock::time_point now);
+    void reset();
+
+private:
+    void groupComplete(clock::time_point last);
+    double incomingRate(clock::time_point now) const;
+    void updateRate(clock::time_point now);
+
+    bool inGroup = false;
+    clock::time_point groupFirst;
+    clock::time_point groupLast;
+    bool havePrevGroup = false;
+    clock::time_point prevGroupLast;
+    clock::time_point start;
+
+    // learned spacing between groups in milliseconds, 0 before the first pair
+    double groupIntervalMs = 0;
+    double accumulatedDelayMs = 0;
+    double smoothedDelayMs = 0;
+    // (arrival ms since start, smoothed delay ms) of recent groups
+    std::deque<std::pair<double, double>> trend;
+    int groups = 0;
+
+    double threshold = 12.5;
+    clock::time_point lastThresholdUpdate;
+    double prevTrend = 0;
+    double overuseMs = 0;
+    int overuseCount = 0;
+    usage detected = NORMAL;
+
+    std::deque<std::pair<clock::time_point, int>> window;
+    uint64_t windowBytes = 0;
+    double rate = 0;
+    clock::time_point lastRateUpdate;
+    clock::time_point lastFeedback;
+    bool decreased = false;
+    // a cut is reported right away instead of waiting for the interval
+    bool decreasePending = false;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Capture file layout: a captureHeader followed by records of an 8 byte arrival
+// time in nanoseconds since the epoch, a 4 byte length and the datagram exactly
+// as received, before decryption. All integers are little endian. A record with
+// length 0 marks the end of a capture that was not closed cleanly.
+// Version 2 keeps the peerCapabilities the server advertised in the header, version 1
+// captures are still read but do not say which formats the session used.
+constexpr char captureMagic[8] = { 'S', 'S', 'C', 'A', 'P', 'T', 0, 0 };
+constexpr uint32_t captureVersion = 2;
+constexpr size_t captureRecordHeader = 12;
+
+struct captureHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t capabilities;
+};
+
+// Append-only capture of received datagrams into a memory mapped file that grows in
+// large steps, so writing a record is a memcpy on the receive path.
+class PacketCapture {
+public:
+    ~PacketCapture();
+
+    // capabilities are the server's, from the handshake answer
+    bool open(const std::string& path, uint8_t capabilities);
+    bool isOpen() const { return map != NULL; }
+    void write(uint64_t arrivalNs, const uint8_t* data, int len);
+    // unmaps and truncates the file to what was written
+    void close();
+
+private:
+    bool grow(size_t need);
+
+    int fd = -1;
+    uint8_t* map = NULL;
+    size_t mapped = 0;
+    size_t used = 0;
+};
+
+// Reads a capture back record by record from a read-only mapping.
+class CaptureReader {
+public:
+    ~CaptureReader();
+
+    bool open(const std::string& path);
+    // false at the end of the capture, data points into the mapping
+    bool next(uint64_t& arrivalNs, const uint8_t*& data, int& len);
+    void close();
+    // the server's peerCapabilities, -1 for version 1 captures that did not record them
+    int capabilities() const { return serverCapabilities; }
+
+private:
+    int fd = -1;
+    int serverCapabilities = -1;
+    const uint8_t* map = NULL;
+    size_t mapped = 0;
+    size_t pos = 0;
+};
+
+// wall clock nanoseconds for capture records
+uint64_t captureNow();
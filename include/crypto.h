@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+#include <openssl/evp.h>
+#include <openssl/aes.h>
+
+// key material and 8 bytes of salt shared with the peer
+const std::string aesKeyData = "2B28AB097EAEF7CF15D2154F16A6883C";
+const unsigned int aesSalt[] = { 12345, 54321 };
+
+// Create 128 bit key and IV using key_data and 8 byte salt and initializes ctx objects
+int aes_init(std::string key_data, int key_data_len, unsigned char* salt, EVP_CIPHER_CTX* e_ctx,
+		EVP_CIPHER_CTX* d_ctx);
+
+// Apply aes-128 encryption based on key and iv values
+// All data going in & out is considered binary
+unsigned char* aes_encrypt(EVP_CIPHER_CTX* e, unsigned char* plaintext, int* len);
+
+// Decrypt aes-128 encryption based on key and iv values
+unsigned char* aes_decrypt(EVP_CIPHER_CTX* e, unsigned char* ciphertext, int* len);
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// latency histogram bins
+constexpr int latencyBuckets = 100;
+constexpr int latencyBucketMs = 5;
+
+// microsecond stamp carried with input, differences are taken with unsigned wraparound
+inline uint32_t latencyStamp(std::chrono::steady_clock::time_point t) {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(t.time_since_epoch()).count();
+}
+
+// Input to photon latency. The peer echoes the stamp of the latest input it applied
+// together with the sequence number of the first frame captured afterwards; once a
+// frame at or after that sequence number is presented the difference is recorded.
+class LatencyProbe {
+public:
+    bool enabled = false;
+
+    // the frame starting at seq reflects input stamped with stamp
+    void frameStamp(int seq, uint32_t stamp);
+    // a frame whose data started at seq was just presented
+    void presented(int seq);
+
+    size_t count() const { return samples.size(); }
+    // latency in milliseconds below which the given fraction of samples fall
+    float percentile(float fraction) const;
+    // sample counts per latencyBucketMs wide bin, the last bin collects everything above
+    const float* histogram() const { return buckets; }
+
+    // writes one sample in microseconds per line, returns false if the file could not be written
+    bool exportTo(const std::string& path) const;
+    void reset();
+
+private:
+    std::vector<std::pair<int, uint32_t>> pending;
+    std::vector<uint32_t> samples;
+    float buckets[latencyBuckets] = {};
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <type_traits>
+
+// records below LOG_MIN_LEVEL are compiled out, set with make LOG_LEVEL=n
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 1
+#endif
+
+enum logLevel {
+    LOGDEBUG = 0,
+    LOGINFO = 1,
+    LOGWARN = 2,
+    LOGERROR = 3
+};
+
+constexpr int maxLogArgs = 4;
+constexpr int logTextSize = 48;
+
+struct logArg {
+    enum { INT, UINT, FLOAT, TEXT } type;
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+    };
+};
+
+// A log record keeps the format string by pointer and its arguments by value,
+// formatting happens on the writer thread. {} in the format is replaced by the next argument.
+struct logRecord {
+    uint64_t ns;
+    const char* format;
+    uint8_t level;
+    uint8_t argCount;
+    logArg args[maxLogArgs];
+    // string arguments are copied back to back, truncated once the buffer is full
+    uint8_t textLen;
+    char text[logTextSize];
+};
+
+// returns a free record in the calling thread's ring, or NULL if the ring is full
+logRecord* logClaim();
+// publishes the record returned by the last logClaim
+void logCommit();
+
+// starts the background writer, records logged before this are kept until it runs
+void logStart(FILE* out);
+// drains every ring and stops the writer
+void logStop();
+
+inline void logPackText(logRecord* r, logArg& a, const char* v) {
+    if(!v) {
+        v = "(null)";
+    }
+    a.type = logArg::TEXT;
+    a.u = r->textLen;
+    while(*v && r->textLen < logTextSize - 1) {
+        r->text[r->textLen++] = *v++;
+    }
+    r->text[r->textLen] = '\0';
+    if(r->textLen < logTextSize - 1) {
+        r->textLen++;
+    }
+}
+
+inline void logPack(logRecord* r, logArg& a, const std::string& v) {
+    logPackText(r, a, v.c_str());
+}
+
+template<typename T>
+inline void logPack(logRecord* r, logArg& a, const T& v) {
+    if constexpr(std::is_convertible_v<const T&, const char*>) {
+        logPackText(r, a, v);
+    } else if constexpr(std::is_floating_point_v<T>) {
+        a.type = logArg::FLOAT;
+        a.d = v;
+    } else if constexpr(std::is_signed_v<T>) {
+        a.type = logArg::INT;
+        a.i = v;
+    } else {
+        a.type = logArg::UINT;
+        a.u = v;
+    }
+}
+
+uint64_t logNow();
+
+template<typename... Args>
+void logWrite(int level, const char* format, const Args&... args) {
+    static_assert(sizeof...(Args) <= maxLogArgs, "too many log arguments");
+    logRecord* r = logClaim();
+    if(!r) {
+        return;
+    }
+    r->ns = logNow();
+    r->format = format;
+    r->level = level;
+    r->argCount = sizeof...(Args);
+    r->textLen = 0;
+    int i = 0;
+    (logPack(r, r->args[i++], args), ...);
+    logCommit();
+}
+
+#define LOG_DEBUG(...) do { if constexpr(LOG_MIN_LEVEL <= LOGDEBUG) logWrite(LOGDEBUG, __VA_ARGS__); } while(0)
+#define LOG_INFO(...) do { if constexpr(LOG_MIN_LEVEL <= LOGINFO) logWrite(LOGINFO, __VA_ARGS__); } while(0)
+#define LOG_WARN(...) do { if constexpr(LOG_MIN_LEVEL <= LOGWARN) logWrite(LOGWARN, __VA_ARGS__); } while(0)
+#define LOG_ERROR(...) do { if constexpr(LOG_MIN_LEVEL <= LOGERROR) logWrite(LOGERROR, __VA_ARGS__); } while(0)
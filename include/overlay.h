@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+
+#include <latency.h>
+#include <stats.h>
+
+// Draws the in-session ImGui layer on top of the current frame: the stats overlay
+// when showStats is set and the latency window while latency is being measured.
+void drawSessionUi(const SessionStats& stats, LatencyProbe& latency, const std::string& latencyFile, bool showStats);
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Hardware performance counters read around pipeline stages with perf_event_open.
+// Counting is per thread: perfStart opens the counters for the calling thread and
+// stages measured on any other thread are ignored. Counters the kernel or the CPU
+// do not provide read as 0.
+enum perfEvent {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    perfEventCount
+};
+
+// stages nest, receive covers the whole of Receiver::receive including the others
+enum perfStage {
+    STAGE_RECEIVE,
+    STAGE_DECRYPT,
+    STAGE_PARSE,
+    STAGE_DECODE,
+    perfStageCount
+};
+
+struct perfCounts {
+    uint64_t values[perfEventCount] = {};
+};
+
+// false with a logged warning if no counter could be opened
+bool perfStart();
+void perfStop();
+// true on the thread that called perfStart while the counters are open
+bool perfActive();
+perfCounts perfRead();
+
+void perfAdd(perfStage stage, const perfCounts& begin, const perfCounts& end);
+void perfReset();
+// one line per stage with its counters divided by packets and by frames
+void perfReport(uint64_t packets, uint64_t frames);
+// end - begin divided by ops, as "cycles 12.3 instructions 45.6 ..." with IPC
+std::string perfFormat(const perfCounts& begin, const perfCounts& end, double ops);
+
+class PerfScope {
+public:
+    PerfScope(perfStage stage) : stage(stage), active(perfActive()) {
+        if(active) {
+            begin = perfRead();
+        }
+    }
+    ~PerfScope() {
+        if(active) {
+            perfAdd(stage, begin, perfRead());
+        }
+    }
+
+    PerfScope(const PerfScope&) = delete;
+    PerfScope& operator=(const PerfScope&) = delete;
+
+private:
+    perfStage stage;
+    bool active;
+    perfCounts begin;
+};
+
+#define PERF_CONCAT2(a, b) a##b
+#define PERF_CONCAT(a, b) PERF_CONCAT2(a, b)
+// counts the rest of the enclosing scope towards stage
+#define PERF_SCOPE(stage) PerfScope PERF_CONCAT(perfScope, __LINE__)(stage)
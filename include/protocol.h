@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+
+// sequence numbers wrap at maxPacketCount and go on the wire as two bytes, high byte first
+constexpr int maxPacketCount = 256 * 60;
+#define maxByteVal 256
+
+// first byte of datagrams sent to the peer
+enum sendPacketTypes {
+    NUMBERED = 1,
+    RETRANSMIT = 2,
+    UNNUMBERED = 3,
+    // count byte followed by records of sequence (2 bytes), length (2 bytes) and payload, newest first
+    BUNDLED = 4,
+    // 32 bit input stamp followed by one of the datagrams above
+    STAMPED = 5
+};
+
+constexpr int stampHeader = 5;
+
+// bits of the byte a server appends to its handshake answer, after the address and a NUL,
+// when it understands the formats below. Servers that do not send it get the original ones.
+enum peerCapabilities {
+    // BUNDLED input datagrams, otherwise input goes out as NUMBERED and UNNUMBERED only
+    BUNDLEDINPUT = 1,
+    // STAMPED input datagrams
+    STAMPEDINPUT = 2,
+    // 'a' acks covering several frame retransmissions, otherwise each is acked with '9'
+    BATCHEDACKS = 4,
+    // 'b' bandwidth estimates, otherwise the receiver keeps its estimate to itself
+    BANDWIDTHESTIMATES = 8,
+    // 'r' receiver reports
+    RECEIVERREPORTS = 16,
+    // 'k' asks for a keyframe after keyframe data was given up on
+    KEYFRAMEREQUESTS = 32
+};
+
+// sequence number of a bundle record that carries an unnumbered message
+constexpr int unnumberedRecord = 0xFFFF;
+
+// first byte of datagrams received from the peer that are not frame data
+enum peerPacketTypes {
+    INPUTACK = 4,
+    // cumulative input ack followed by a 32 bit selective ack bitmap
+    INPUTSACK = 6,
+    // sequence number of a frame's first packet followed by the input stamp it reflects
+    FRAMESTAMP = 7
+};
+
+// compares two 16 bit sequence numbers
+// returns -1 for num1 < num2, 0 for equal, and 1 for greater
+inline int compareSeqNum(uint16_t num1, uint16_t num2) {
+    if(num1 == num2) 
+        return 0;
+    
+    if (num1 < num2 && num2 - num1 < (maxPacketCount) / 2 ||
+        num1 > num2 && num1 - num2 > (maxPacketCount) / 2) {
+        return -1;
+    }
+
+    return 1;
+}
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// FFMPEG
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#include <bandwidth.h>
+#include <crypto.h>
+#include <latency.h>
+#include <protocol.h>
+#include <rtt.h>
+#include <stats.h>
+
+// read buffer
+enum receivePacketType {
+    FRAME = 0,
+    INPUTRETRANSMIT = 1,
+    INPUTRETRANSMITIND = 2
+};
+struct recvPacket {
+    bool transmitRequested = false;
+    int dataLen = -1;
+    uint8_t data[1500];
+    receivePacketType type = FRAME;
+    int visited = -1;
+    // header byte of the last slice or parameter set NAL unit started at or before this
+    // packet, inherited from the packet before when none starts here. 0 when unknown,
+    // which a missing packet is unless its neighbours show it lies inside one P picture.
+    uint8_t nal = 0;
+    // arrival of the first packet of the picture this packet ends in
+    std::chrono::time_point<std::chrono::steady_clock> frameStart;
+    // header byte of the first NAL unit starting in this packet, 0 if none does, and whether it
+    // continues a P picture. Scanned once on arrival so gaps are classified without rescanning.
+    uint8_t firstNal = 0;
+    bool continuesP = false;
+};
+
+// how often a receiver report goes upstream while packets are arriving
+constexpr std::chrono::milliseconds reportInterval = std::chrono::milliseconds(100);
+// retransmissions are acked together, at most this long after the first of them arrived
+constexpr std::chrono::milliseconds ackDelay = std::chrono::milliseconds(20);
+// or as soon as this many are waiting
+constexpr int ackBatch = 32;
+
+// hands send the 'a' messages acking seqs, which is sorted in place
+void encodeAcks(std::vector<int>& seqs, const std::function<void(const std::string&)>& send);
+// '7' and the sequence number of a missing frame packet
+std::string encodeNack(int seq);
+
+// the type byte and sequence number every datagram from the server starts with
+struct datagramHeader {
+    int type = 0;
+    int seq = 0;
+};
+// false if the datagram is too short to have one
+bool parseHeader(const uint8_t* data, int len, datagramHeader& header);
+
+//retransmission
+struct retransmitRequest {
+    // first NACK, only timed while attempts is 0
+    std::chrono::time_point<std::chrono::steady_clock> sent;
+    std::chrono::time_point<std::chrono::steady_clock> due;
+    // the frame is decoded without the packet after this, playoutDelay after its first packet arrived
+    std::chrono::time_point<std::chrono::steady_clock> deadline;
+    // keyframe data, or data that may be, is waited for up to keyframeWait and asked for first
+    bool keyframe = false;
+    // a packet arrived next to the gap since it was classified as keyframe data
+    bool reclassify = false;
+    int attempts = 0;
+    std::string data;
+};
+
+// Receive path shared by the client and the offline tools: sequencing, gap detection
+// and NACKs, reassembly in sequence order, then H.264 parsing and decoding. Nothing
+// here touches a socket or a window, the embedding program wires up the hooks.
+class Receiver {
+public:
+    using clock = std::chrono::steady_clock;
+
+    Receiver();
+    ~Receiver();
+
+    // sets up the decoder and cipher, returns false with a logged error if that fails
+    bool init();
+    // handles one datagram exactly as it came off the socket
+    void receive(const uint8_t* data, int len, clock::time_point arrival);
+    // resends frame NACKs whose timer ran out and flushes delayed acks, returns how long
+    // until the next one is due
+    std::chrono::milliseconds resendNacks();
+    int nacksOutstanding();
+    // takes the socket's cumulative SO_RXQ_OVFL counter, drops it counts are local overload,
+    // not network loss, and are reported upstream separately
+    void socketDrops(uint32_t total);
+    // smoothed NACK round trip time, 0 until the first retransmission arrived
+    std::chrono::microseconds srtt();
+    // forgets the session, the decoder is kept
+    void reset();
+
+    // sends an unnumbered message such as an ack or NACK to the peer
+    std::function<void(const std::string&)> sendControl;
+    // called for every decoded frame, frame->pts is the sequence number the frame started at
+    std::function<void(AVFrame*)> present;
+    // input acks (INPUTACK, INPUTSACK) as received
+    std::function<void(const uint8_t*, int)> inputControl;
+    // the peer is missing the input message with this sequence number
+    std::function<void(int)> inputRetransmit;
+    // clock for NACK timers, deadlines and giving up. Replays set it to the capture's
+    // arrival times so a capture always leads to the same decisions.
+    std::function<clock::time_point()> timeSource = clock::now;
+
+    // how long a lost packet may hold up decoding before its frame is decoded without it,
+    // NACKs that cannot be answered in time are not sent. 0 waits for every retransmission,
+    // keyframe data only up to keyframeWait.
+    std::chrono::milliseconds playoutDelay = std::chrono::milliseconds(200);
+    // how long keyframe data, or a gap that may hold some, can hold up decoding. It is then
+    // skipped as well and a new keyframe asked for, the decoder conceals until it arrives.
+    // 0 waits for it forever.
+    std::chrono::milliseconds keyframeWait = std::chrono::milliseconds(1000);
+    // acks retransmissions in batches with 'a', only for peers that advertise BATCHEDACKS.
+    // Otherwise each one is acked right away with '9'.
+    std::atomic<bool> batchAcks = false;
+    // sends the bandwidth estimate with 'b', only to peers that advertise BANDWIDTHESTIMATES.
+    // It is measured and shown in the stats either way.
+    std::atomic<bool> sendEstimates = false;
+    // sends 'r' receiver reports every reportInterval, only to peers that advertise RECEIVERREPORTS
+    std::atomic<bool> sendReports = false;
+    // asks for a keyframe with 'k' when keyframe data is skipped, only peers that advertise
+    // KEYFRAMEREQUESTS understand it. The gap is skipped after keyframeWait either way.
+    std::atomic<bool> requestKeyframes = false;
+
+    // main thread only
+    SessionStats stats;
+    LatencyProbe latency;
+    BandwidthEstimator bandwidth;
+
+private:
+    void nack(int seq);
+    bool settled(int seq);
+    bool insidePicture(int seq);
+    void classify(int seq, retransmitRequest& req);
+    void neighbourArrived(int seq);
+    void reclassifyLater(int seq);
+    void ack(int seq, clock::time_point arrival);
+    void flushAcks();
+    bool hopeless(const retransmitRequest& req, clock::time_point now);
+    bool giveUp(int seq);
+    void sendEstimate();
+    void requestKeyframe(clock::time_point now);
+    void trackSequence(int seq);
+    void sendReport(clock::time_point now);
+    void decode();
+    void drain();
+
+    std::unique_ptr<recvPacket[]> buf;
+    std::vector<int> unorderedPack;
+    // outstanding frame NACKs, shared with the thread calling resendNacks
+    std::map<int, retransmitRequest> retransmits;
+    // NACK to retransmission round trips, under retransMutex
+    RttEstimator rtt;
+    // NACKs not sent because the retransmission would be too late, copied into stats
+    std::atomic<uint64_t> suppressed = 0;
+    // retransmissions not acked yet, under retransMutex
+    std::vector<int> pendingAcks;
+    // only written by the receiving thread
+    clock::time_point ackDue;
+    clock::time_point lastKeyframeRequest;
+    std::mutex retransMutex;
+
+    // for tracking position in packet queue
+    int prevIndex = -1;
+    int index = -1;
+    int packetPos = 0;
+
+    // receiver report state, sequence numbers extended past the wrap
+    bool haveSeq = false;
+    int highestSeq = 0;
+    uint32_t extendedHighest = 0;
+    uint32_t baseSeq = 0;
+    uint64_t seqReceived = 0;
+    uint64_t lastExpected = 0;
+    uint64_t lastSeqReceived = 0;
+    clock::time_point lastReport;
+    uint64_t lastDecoded = 0;
+    uint64_t lastDecodeUs = 0;
+    uint64_t lastPresented = 0;
+    uint64_t lastPresentUs = 0;
+    uint32_t lastSocketDrops = 0;
+    uint32_t reportSocketDrops = 0;
+
+    const AVCodec* codec = NULL;
+    AVCodecParserContext* parser = NULL;
+    AVCodecContext* c = NULL;
+    AVFrame* frame = NULL;
+    AVPacket* pkt = NULL;
+
+    /* ctx structures that libcrypto used to record encryption/decryption status */
+    EVP_CIPHER_CTX* en;
+    EVP_CIPHER_CTX* de;
+};
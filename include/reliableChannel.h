@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <protocol.h>
+#include <rtt.h>
+#include <sendQueue.h>
+
+// largest payload that still fits a stamped datagram as a single bundle record
+constexpr int maxInputPayload = maxDatagramSize - 6 - stampHeader;
+
+// Reliable channel for input messages. Payloads of any length up to maxInputPayload
+// are kept in a byte ring until acknowledged, either one at a time or cumulatively
+// with a selective ack bitmap, and are resent on an RTT derived timeout.
+// When the peer takes BUNDLED datagrams, every datagram the channel sends also repeats up
+// to redundancy of the newest unacknowledged messages, so a single lost datagram is
+// covered by the next one.
+class ReliableChannel {
+public:
+    ReliableChannel(SendQueue& out, size_t ringBytes, int window, int redundancy);
+
+    // numbers and sends payload, returns false if it is too large or the window is full
+    bool send(const std::string& payload);
+    // sends payload without numbering it, piggybacking any unacknowledged messages
+    // eventTime is when the input it describes happened
+    void sendUnreliable(const std::string& payload, std::chrono::steady_clock::time_point eventTime);
+
+    // acknowledges a single message
+    void ack(int seq);
+    // acknowledges every message before next, bit i of sack acknowledges next + 1 + i
+    void ackCumulative(int next, uint32_t sack);
+    // resends seq immediately, used when the peer reports it missing
+    void retransmit(int seq);
+    // resends every message whose timer ran out, returns how long until the next check
+    std::chrono::milliseconds resendDue();
+
+    // drops everything in flight and restarts numbering at 0
+    void reset();
+
+    // smoothed round trip time, 0 until the first ack
+    std::chrono::microseconds srtt();
+
+    // prefixes every datagram with the time of the input it carries, for latency measurement,
+    // only for peers that advertise STAMPEDINPUT
+    std::atomic<bool> stampInput = false;
+    // repeats unacknowledged messages in BUNDLED datagrams, only for peers that advertise BUNDLEDINPUT
+    std::atomic<bool> bundleInput = false;
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct entry {
+        uint32_t offset;
+        uint16_t len;
+        bool acked;
+        int attempts;
+        clock::time_point sent;
+        clock::time_point due;
+    };
+
+    bool inFlight(int seq) const;
+    void markAcked(int seq, clock::time_point now);
+    void advance();
+    void retransmitOne(int seq, clock::time_point now);
+    void transmitBundled(int seq, const uint8_t* payload, size_t len, clock::time_point eventTime);
+    void emit(uint8_t* buffer, int len, clock::time_point eventTime);
+
+    SendQueue& out;
+    std::mutex lock;
+    std::vector<uint8_t> ring;
+    std::vector<entry> entries;
+    size_t head = 0;
+    size_t tail = 0;
+    int oldest = 0;
+    int next = 0;
+    int inflight = 0;
+    int redundancy;
+    RttEstimator rtt;
+};
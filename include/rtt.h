@@ -0,0 +1,39 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+
+// used before the first round trip has been measured
+constexpr std::chrono::milliseconds initialRto = std::chrono::milliseconds(300);
+constexpr std::chrono::milliseconds minRto = std::chrono::milliseconds(20);
+constexpr std::chrono::milliseconds maxRto = std::chrono::milliseconds(3000);
+// resend timers back off up to 2^maxBackoff times the current timeout
+constexpr int maxBackoff = 5;
+
+// Smoothed round trip time and retransmit timeout as described in RFC 6298
+struct RttEstimator {
+    std::chrono::microseconds srtt = std::chrono::microseconds(0);
+    std::chrono::microseconds rttvar = std::chrono::microseconds(0);
+    bool haveSample = false;
+
+    void sample(std::chrono::microseconds rtt) {
+        if(!haveSample) {
+            srtt = rtt;
+            rttvar = rtt / 2;
+            haveSample = true;
+            return;
+        }
+        auto err = rtt > srtt ? rtt - srtt : srtt - rtt;
+        rttvar = (rttvar * 3 + err) / 4;
+        srtt = (srtt * 7 + rtt) / 8;
+    }
+
+    // initial is used until the first sample arrives
+    std::chrono::milliseconds rto(std::chrono::milliseconds initial) const {
+        if(!haveSample) {
+            return initial;
+        }
+        auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(srtt + rttvar * 4);
+        return std::clamp(timeout, minRto, maxRto);
+    }
+};
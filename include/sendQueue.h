@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#include <SDL2/SDL.h>
+
+#include <udpSocket.h>
+
+constexpr int maxDatagramSize = 1500;
+
+// Bounded multi-producer queue of outgoing datagrams drained by one sender thread.
+// Producers copy into a slot owned by the queue, so callers never share a buffer and
+// never block on the socket. The sender hands whatever is queued to the socket in batches
+// straight from the slots.
+class SendQueue {
+public:
+    // capacity is rounded up to a power of two
+    explicit SendQueue(size_t capacity);
+    ~SendQueue();
+
+    // copies len bytes into the queue, returns false if the queue is full or len is too large
+    bool push(const uint8_t* data, int len);
+
+    // discards anything queued before and starts the sender thread, sending every datagram
+    // pushed from then on to sock's peer
+    void open(UdpSocket* sock);
+    // stops the sender thread and discards anything still queued
+    void close();
+
+    // datagrams refused because the queue was full, too large or not open, since open
+    std::atomic<uint64_t> dropped = 0;
+
+private:
+    struct slot {
+        std::atomic<size_t> sequence;
+        int len;
+        uint8_t data[maxDatagramSize];
+    };
+
+    // the queued slot offset places behind the oldest, NULL if there is none
+    slot* peek(size_t offset);
+    // hands the oldest count slots back to the producers
+    void release(int count);
+    void sendLoop();
+    void discard();
+
+    std::unique_ptr<slot[]> slots;
+    size_t mask;
+    // producers and the consumer sit on separate cache lines
+    alignas(64) std::atomic<size_t> enqueuePos = 0;
+    alignas(64) size_t dequeuePos = 0;
+
+    // created by the first open, SDL may not be initialised when the queue is constructed
+    SDL_sem* ready = NULL;
+    std::atomic<bool> running = false;
+    std::thread sender;
+    UdpSocket* sock = NULL;
+};
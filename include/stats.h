@@ -0,0 +1,96 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// samples kept per graph, one per statsInterval
+constexpr int statsHistory = 120;
+constexpr std::chrono::milliseconds statsInterval = std::chrono::milliseconds(250);
+
+// Fixed length series for ImGui::PlotLines, offset points at the oldest value
+struct statsSeries {
+    float values[statsHistory] = {};
+    int offset = 0;
+    float last = 0;
+
+    void push(float value) {
+        values[offset] = value;
+        offset = (offset + 1) % statsHistory;
+        last = value;
+    }
+};
+
+// Session counters updated from the receive, decode and present paths on the main
+// thread and rolled into rate series every statsInterval.
+class SessionStats {
+public:
+    using clock = std::chrono::steady_clock;
+
+    void packetReceived(int bytes, clock::time_point arrival);
+    void packetsLost(int count) { lost += count; windowLost += count; }
+    void packetRecovered() { recovered++; windowRecovered++; }
+    void nackSent() { nacks++; }
+    void packetSkipped() { skipped++; }
+    void keyframeRequested() { keyframeRequests++; }
+    void kernelDropped(int count) { kernelDrops += count; windowKernelDrops += count; }
+    void decoded(std::chrono::microseconds took);
+    void presented(std::chrono::microseconds took);
+
+    // true once statsInterval has passed since the last tick
+    bool due(clock::time_point now) const { return now - windowStart >= statsInterval; }
+    // rolls the current window into the series
+    void tick(clock::time_point now, int nacksOutstanding, std::chrono::microseconds rtt);
+    void reset();
+
+    // totals for the session
+    uint64_t bytes = 0;
+    uint64_t packets = 0;
+    uint64_t lost = 0;
+    uint64_t recovered = 0;
+    uint64_t nacks = 0;
+    // NACKs withheld because the retransmission could not arrive before the frame's deadline
+    uint64_t nacksSuppressed = 0;
+    // lost packets given up on, their frames were decoded without them
+    uint64_t skipped = 0;
+    // keyframe data given up on after keyframeWait, each time a new keyframe was due
+    uint64_t keyframeRequests = 0;
+    // datagrams the socket dropped because its receive buffer was full, part of lost as well
+    uint64_t kernelDrops = 0;
+    // outgoing datagrams discarded because the send queue was full, copied from it by the caller
+    uint64_t sendDrops = 0;
+    uint64_t frames = 0;
+    uint64_t decodedFrames = 0;
+    uint64_t decodeUs = 0;
+    uint64_t presentUs = 0;
+    // smoothed variation between successive packet arrival gaps, in milliseconds
+    double jitterMs = 0;
+    // latest available bandwidth estimate in bits per second, kept up to date by the receiver
+    double estimateBps = 0;
+
+    statsSeries bitrateMbps;
+    statsSeries estimateMbps;
+    statsSeries packetRate;
+    statsSeries lossRate;
+    statsSeries kernelDropRate;
+    statsSeries recoveryRate;
+    statsSeries nacksOutstanding;
+    statsSeries rttMs;
+    statsSeries jitter;
+    statsSeries decodeMs;
+    statsSeries presentMs;
+    statsSeries fps;
+
+private:
+    clock::time_point windowStart;
+    clock::time_point lastArrival;
+    double lastGapMs = -1;
+    uint64_t windowBytes = 0;
+    uint64_t windowPackets = 0;
+    uint64_t windowLost = 0;
+    uint64_t windowKernelDrops = 0;
+    uint64_t windowRecovered = 0;
+    uint64_t windowFrames = 0;
+    uint64_t windowDecoded = 0;
+    double windowDecodeUs = 0;
+    double windowPresentUs = 0;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Scoped timing spans kept in a fixed size in-memory ring, newest overwrite oldest.
+// Each span carries a correlation id, the packet sequence number for receive stages
+// and the sequence number a frame started at for decode and present stages.
+extern std::atomic<bool> traceEnabled;
+
+uint64_t traceNow();
+void traceRecord(const char* name, uint64_t startNs, uint64_t endNs, uint32_t id);
+
+// writes the ring as Chrome trace event JSON, viewable in chrome://tracing or Perfetto
+bool traceDump(const std::string& path);
+
+class TraceSpan {
+public:
+    TraceSpan(const char* name, uint32_t id) : name(name), id(id) {
+        start = traceEnabled.load(std::memory_order_relaxed) ? traceNow() : 0;
+    }
+    ~TraceSpan() {
+        if(start) {
+            traceRecord(name, start, traceNow(), id);
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name;
+    uint32_t id;
+    uint64_t start;
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+// times the rest of the enclosing scope
+#define TRACE_SPAN(name, id) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(name, id)
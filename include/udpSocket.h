@@ -0,0 +1,171 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#ifdef __linux__
+#include <netinet/in.h>
+#include <sys/socket.h>
+#else
+#include <SDL2/SDL_net.h>
+#endif
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+// io_uring_setup_buf_ring came with liburing 2.4, as did the version macros
+#ifndef IO_URING_VERSION_MAJOR
+#error "URING=1 needs liburing 2.4 or newer"
+#endif
+#endif
+
+// socket receive buffer asked for by default, the kernel caps SO_RCVBUF at net.core.rmem_max
+// unless SO_RCVBUFFORCE is allowed (CAP_NET_ADMIN)
+constexpr int defaultReceiveBuffer = 8 * 1024 * 1024;
+// most datagrams moved by one receiveBatch or sendBatch call
+constexpr int socketBatch = 32;
+// largest datagram received whole, the peer never sends more than a frame packet
+constexpr int maxReceiveSize = 2048;
+// largest train of equal sized datagrams UDP_GRO hands up in one piece
+constexpr int maxGroSize = 65535;
+// buffers in the io_uring provided buffer ring, powers of two. Fewer when each has to
+// hold a whole GRO train.
+constexpr int uringBuffers = 1024;
+constexpr int uringGroBuffers = 256;
+
+// what wait() woke up for
+enum socketEvents {
+    SOCKET_READABLE = 1,
+    SOCKET_TIMER = 2
+};
+
+#ifdef __linux__
+using peerAddress = sockaddr_in;
+#else
+using peerAddress = IPaddress;
+#endif
+
+// one datagram of a batch, len bytes at data. Sent datagrams are in caller memory,
+// received ones in the socket's and only valid until the next receiveBatch call that
+// has to go back to the socket.
+struct datagram {
+    uint8_t* data;
+    int size;
+    int len;
+    // received ones only, when the kernel took it off the wire if timestamps are enabled,
+    // otherwise when receiveBatch picked it up
+    std::chrono::steady_clock::time_point arrival;
+};
+
+// The stream's UDP socket. On Linux a nonblocking socket waited on with epoll together
+// with a timerfd, datagrams move in batches through recvmmsg and sendmmsg. Built with
+// HAVE_LIBURING it can receive through io_uring instead: one multishot recvmsg fills a
+// ring of provided buffers that receiveBatch hands out in place, so a busy stream costs
+// no system call per batch. With offload the kernel coalesces arriving datagrams into
+// GRO trains that receiveBatch splits up again, and sendBatch hands runs of equal sized
+// datagrams to the kernel as one segmented message. Elsewhere the same interface runs on
+// SDL_net one datagram at a time, without the socket options. One thread may send while
+// another receives.
+class UdpSocket {
+public:
+    ~UdpSocket();
+
+    // opens a socket on an ephemeral port
+    bool open();
+    void close();
+    bool isOpen() const;
+    // "epoll", "io_uring" or "SDL_net", whichever open() ended up with
+    const char* backend() const;
+    int localPort() const;
+
+    static bool resolve(const char* host, int port, peerAddress& out);
+    // where send and sendBatch go
+    void setPeer(const peerAddress& to);
+
+    bool sendTo(const uint8_t* data, int len, const peerAddress& to);
+    bool send(const uint8_t* data, int len);
+    // sends up to count datagrams to the peer, returns how many went out
+    int sendBatch(const datagram* batch, int count);
+    // takes up to count waiting datagrams without blocking, returns how many were taken.
+    // Segments of a GRO train that did not fit come first in the next call.
+    int receiveBatch(datagram* batch, int count);
+
+    // blocks until a datagram is waiting, the timer fired or timeout passed, returns socketEvents bits
+    int wait(std::chrono::milliseconds timeout);
+    // wakes wait() every interval until set to 0
+    bool setTimer(std::chrono::milliseconds interval);
+
+    // asks for a receive buffer of bytes, returns what the kernel granted
+    int setReceiveBuffer(int bytes);
+    // has datagrams carry the socket's drop counter (SO_RXQ_OVFL), kept in drops
+    bool enableDropCounter();
+    // has the kernel stamp datagrams as they arrive (SO_TIMESTAMPNS), see datagram::arrival
+    bool enableTimestamps();
+    // datagrams the socket dropped so far. The kernel samples the counter when a datagram
+    // is queued and leaves it out while it is 0, so drops show up with the next one to fit.
+    uint32_t drops = 0;
+
+    // read by open(), io_uring falls back to epoll when it is not built in or the kernel
+    // lacks multishot recvmsg (6.0)
+    bool preferUring = false;
+    // read by open(), UDP_GRO on receive and UDP_SEGMENT on send where the kernel has them
+    bool offload = true;
+    // whether open() got UDP_GRO, and UDP_SEGMENT until a send fails with it
+    bool receiveCoalescing() const;
+    bool sendSegmentation() const;
+
+private:
+    // fills segments from the socket, one call's worth
+    void receiveSegments();
+    // splits a GRO train of segmentSize datagrams, 0 for a single datagram. The segments of
+    // a train share the stamp of its first datagram.
+    void addSegments(uint8_t* data, int len, int segmentSize, std::chrono::steady_clock::time_point arrival);
+
+    // receiveBatch lands datagrams here unless io_uring is used, slotSize bytes each
+    std::unique_ptr<uint8_t[]> storage;
+    int slotSize = maxReceiveSize;
+    // received datagrams not handed out yet, nextSegment is the first of them
+    std::vector<datagram> segments;
+    size_t nextSegment = 0;
+    bool groOn = false;
+    bool gsoOn = false;
+#ifdef __linux__
+    int fd = -1;
+    int epollFd = -1;
+    int timerFd = -1;
+    // picks the drop counter, the GRO segment size and the receive timestamp out of a
+    // received control message
+    void readControl(const cmsghdr* c, int& segmentSize, timespec& stamp);
+#ifdef HAVE_LIBURING
+    bool openUring();
+    void closeUring();
+    void armReceive();
+    void armTimer();
+    // takes timer completions off the front of the queue, returns SOCKET_TIMER if there were any
+    int takeTimers();
+    void receiveUring();
+    int waitUring(std::chrono::milliseconds timeout);
+
+    bool uring = false;
+    io_uring ring;
+    io_uring_buf_ring* bufRing = NULL;
+    int ringCount = 0;
+    int ringBufferSize = 0;
+    std::unique_ptr<uint8_t[]> ringBuffers;
+    // tells multishot recvmsg how much room the address and control data take in each buffer
+    msghdr ringMsg = {};
+    // buffers behind the current segments, returned to the ring once they are all taken
+    std::vector<uint16_t> held;
+#endif
+#else
+    UDPsocket sock = NULL;
+    SDLNet_SocketSet set = NULL;
+    // one each for the sending and the receiving thread
+    UDPpacket* sendPacket = NULL;
+    UDPpacket* recvPacket = NULL;
+    std::chrono::milliseconds timerInterval = std::chrono::milliseconds(0);
+    std::chrono::steady_clock::time_point timerDue;
+#endif
+    peerAddress peer = {};
+};
@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <cmath>
+
+#include <bandwidth.h>
+
+using namespace std;
+
+// trendline settings from the GCC draft and its reference implementation
+constexpr size_t trendWindow = 20;
+constexpr double trendSmoothing = 0.9;
+constexpr double trendGain = 4.0;
+constexpr double thresholdUp = 0.01;
+constexpr double thresholdDown = 0.00018;
+constexpr double overuseTimeMs = 10;
+// the expected group spacing follows the measured one this slowly, and only while the
+// link is not overused so a growing queue is not learned as a slower frame rate
+constexpr double intervalSmoothing = 0.005;
+constexpr double decreaseFactor = 0.85;
+constexpr double increasePerSecond = 1.08;
+
+void BandwidthEstimator::packetReceived(clock::time_point arrival, int bytes) {
+    if(start == clock::time_point()) {
+        start = arrival;
+    }
+    window.push_back({ arrival, bytes });
+    windowBytes += bytes;
+    while(!window.empty() && arrival - window.front().first > bandwidthRateWindow) {
+        windowBytes -= window.front().second;
+        window.pop_front();
+    }
+
+    if(inGroup && arrival - groupFirst > bandwidthBurst) {
+        groupComplete(groupLast);
+        inGroup = false;
+    }
+    if(!inGroup) {
+        inGroup = true;
+        groupFirst = arrival;
+    }
+    groupLast = arrival;
+}
+
+void BandwidthEstimator::groupComplete(clock::time_point last) {
+    if(!havePrevGroup) {
+        havePrevGroup = true;
+        prevGroupLast = last;
+        return;
+    }
+    double deltaMs = chrono::duration<double, milli>(last - prevGroupLast).count();
+    prevGroupLast = last;
+    if(groupIntervalMs == 0) {
+        groupIntervalMs = deltaMs;
+        return;
+    }
+
+    // positive when this group took longer to arrive than the sender took to send it
+    double delayMs = deltaMs - groupIntervalMs;
+    if(detected == NORMAL) {
+        groupIntervalMs += intervalSmoothing * (deltaMs - groupIntervalMs);
+    }
+    accumulatedDelayMs += delayMs;
+    smoothedDelayMs = trendSmoothing * smoothedDelayMs + (1 - trendSmoothing) * accumulatedDelayMs;
+    double nowMs = chrono::duration<double, milli>(last - start).count();
+    trend.push_back({ nowMs, smoothedDelayMs });
+    if(trend.size() > trendWindow) {
+        trend.pop_front();
+    }
+    groups++;
+    if(trend.size() < trendWindow) {
+        return;
+    }
+
+    // least squares slope of delay over time
+    double meanX = 0, meanY = 0;
+    for(auto& point : trend) {
+        meanX += point.first;
+        meanY += point.second;
+    }
+    meanX /= trend.size();
+    meanY /= trend.size();
+    double num = 0, den = 0;
+    for(auto& point : trend) {
+        num += (point.first - meanX) * (point.second - meanY);
+        den += (point.first - meanX) * (point.first - meanX);
+    }
+    double slope = den > 0 ? num / den : 0;
+    double modified = min(groups, 60) * slope * trendGain;
+
+    if(modified > threshold) {
+        overuseMs += deltaMs;
+        overuseCount++;
+        if(overuseMs > overuseTimeMs && overuseCount > 1 && modified >= prevTrend) {
+            overuseMs = 0;
+            overuseCount = 0;
+            detected = OVERUSE;
+        }
+    } else if(modified < -threshold) {
+        overuseMs = 0;
+        overuseCount = 0;
+        detected = UNDERUSE;
+    } else {
+        overuseMs = 0;
+        overuseCount = 0;
+        detected = NORMAL;
+    }
+    prevTrend = modified;
+
+    // the threshold follows the trend, quickly upwards and slowly downwards, ignoring spikes
+    if(lastThresholdUpdate == clock::time_point()) {
+        lastThresholdUpdate = last;
+    }
+    if(fabs(modified) <= threshold + 15) {
+        double k = fabs(modified) < threshold ? thresholdDown : thresholdUp;
+        double dtMs = min(chrono::duration<double, milli>(last - lastThresholdUpdate).count(), 100.0);
+        threshold = clamp(threshold + k * (fabs(modified) - threshold) * dtMs, 6.0, 600.0);
+    }
+    lastThresholdUpdate = last;
+
+    updateRate(last);
+}
+
+double BandwidthEstimator::incomingRate(clock::time_point now) const {
+    if(window.empty()) {
+        return 0;
+    }
+    double seconds = chrono::duration<double>(max(now - window.front().first, clock::duration(bandwidthRateWindow))).count();
+    return windowBytes * 8 / seconds;
+}
+
+void BandwidthEstimator::updateRate(clock::time_point now) {
+    double incoming = incomingRate(now);
+    if(now - start < bandwidthRateWindow || incoming == 0) {
+        return;
+    }
+    if(rate == 0) {
+        rate = incoming;
+        lastRateUpdate = now;
+        return;
+    }
+    double seconds = min(chrono::duration<double>(now - lastRateUpdate).count(), 1.0);
+    lastRateUpdate = now;
+    switch(detected) {
+        case OVERUSE:
+            // only cut once per overuse period, the incoming rate needs time to follow
+            if(!decreased) {
+                rate = min(rate, decreaseFactor * incoming);
+                decreased = true;
+                decreasePending = true;
+            }
+            break;
+        case NORMAL:
+            // the estimate may not run far ahead of what is actually arriving
+            rate = min(rate * pow(increasePerSecond, seconds), 1.5 * incoming + 10000);
+            break;
+        case UNDERUSE:
+            break;
+    }
+    if(detected != OVERUSE && decreased) {
+        decreased = false;
+    }
+}
+
+bool BandwidthEstimator::feedbackDue(clock::time_point now) {
+    if(rate == 0) {
+        return false;
+    }
+    if(now - lastFeedback >= bandwidthFeedbackInterval || decreasePending) {
+        lastFeedback = now;
+        decreasePending = false;
+        return true;
+    }
+    return false;
+}
+
+void BandwidthEstimator::reset() {
+    *this = BandwidthEstimator();
+}
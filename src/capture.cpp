@@ -0,0 +1,171 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#include <capture.h>
+#include <log.h>
+
+using namespace std;
+
+// the mapping grows this much at a time, a couple of seconds at high bitrates
+constexpr size_t captureGrowStep = 64 << 20;
+
+PacketCapture::~PacketCapture() {
+    close();
+}
+
+uint64_t captureNow() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+bool PacketCapture::open(const string& path, uint8_t capabilities) {
+    close();
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        LOG_ERROR("could not open capture file {}: {}", path, strerror(errno));
+        return false;
+    }
+    if(!grow(sizeof(captureHeader))) {
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+    captureHeader header = {};
+    memcpy(header.magic, captureMagic, sizeof(header.magic));
+    header.version = captureVersion;
+    header.capabilities = capabilities;
+    memcpy(map, &header, sizeof(header));
+    used = sizeof(header);
+    LOG_INFO("capturing received datagrams to {}", path);
+    return true;
+}
+
+bool PacketCapture::grow(size_t need) {
+    size_t size = mapped;
+    while(size < used + need) {
+        size += captureGrowStep;
+    }
+    if(map) {
+        munmap(map, mapped);
+        map = NULL;
+    }
+    // allocated rather than sparse, a full disk then fails here instead of raising SIGBUS
+    // on a store into the mapping
+    int error = posix_fallocate(fd, mapped, size - mapped);
+    if(error != 0) {
+        LOG_ERROR("could not grow capture file, capture stopped: {}", strerror(error));
+        return false;
+    }
+    void* region = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(region == MAP_FAILED) {
+        LOG_ERROR("could not map capture file: {}", strerror(errno));
+        return false;
+    }
+    map = (uint8_t*)region;
+    mapped = size;
+    return true;
+}
+
+void PacketCapture::write(uint64_t arrivalNs, const uint8_t* data, int len) {
+    if(!map || len <= 0) {
+        return;
+    }
+    if(used + captureRecordHeader + len > mapped && !grow(captureRecordHeader + len)) {
+        close();
+        return;
+    }
+    uint32_t length = len;
+    memcpy(map + used, &arrivalNs, sizeof(arrivalNs));
+    memcpy(map + used + 8, &length, sizeof(length));
+    memcpy(map + used + captureRecordHeader, data, len);
+    used += captureRecordHeader + len;
+}
+
+void PacketCapture::close() {
+    if(fd < 0) {
+        return;
+    }
+    if(map) {
+        munmap(map, mapped);
+        map = NULL;
+    }
+    if(ftruncate(fd, used) < 0) {
+        LOG_WARN("could not truncate capture file: {}", strerror(errno));
+    }
+    ::close(fd);
+    fd = -1;
+    mapped = 0;
+    used = 0;
+}
+
+CaptureReader::~CaptureReader() {
+    close();
+}
+
+bool CaptureReader::open(const string& path) {
+    close();
+    fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        LOG_ERROR("could not open capture file {}: {}", path, strerror(errno));
+        return false;
+    }
+    off_t size = lseek(fd, 0, SEEK_END);
+    if(size < (off_t)sizeof(captureHeader)) {
+        LOG_ERROR("{} is too short to be a capture", path);
+        close();
+        return false;
+    }
+    void* region = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(region == MAP_FAILED) {
+        LOG_ERROR("could not map capture file: {}", strerror(errno));
+        close();
+        return false;
+    }
+    map = (const uint8_t*)region;
+    mapped = size;
+    captureHeader header;
+    memcpy(&header, map, sizeof(header));
+    if(memcmp(header.magic, captureMagic, sizeof(header.magic)) != 0 || header.version < 1 ||
+            header.version > captureVersion) {
+        LOG_ERROR("{} is not a version 1 to {} capture", path, captureVersion);
+        close();
+        return false;
+    }
+    serverCapabilities = header.version >= 2 ? (int)header.capabilities : -1;
+    pos = sizeof(header);
+    return true;
+}
+
+bool CaptureReader::next(uint64_t& arrivalNs, const uint8_t*& data, int& len) {
+    if(!map || pos + captureRecordHeader > mapped) {
+        return false;
+    }
+    uint32_t length;
+    memcpy(&arrivalNs, map + pos, sizeof(arrivalNs));
+    memcpy(&length, map + pos + 8, sizeof(length));
+    if(length == 0 || pos + captureRecordHeader + length > mapped) {
+        return false;
+    }
+    data = map + pos + captureRecordHeader;
+    len = length;
+    pos += captureRecordHeader + length;
+    return true;
+}
+
+void CaptureReader::close() {
+    if(map) {
+        munmap((void*)map, mapped);
+        map = NULL;
+    }
+    if(fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    mapped = 0;
+    pos = 0;
+    serverCapabilities = -1;
+}
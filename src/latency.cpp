@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <fstream>
+
+#include <latency.h>
+#include <protocol.h>
+
+using namespace std;
+
+// cap on kept samples, about an hour of clicks and key presses
+constexpr size_t maxLatencySamples = 1 << 20;
+// stamps whose frame never shows up are dropped past this many
+constexpr size_t maxPendingStamps = 64;
+
+void LatencyProbe::frameStamp(int seq, uint32_t stamp) {
+    if(!enabled) {
+        return;
+    }
+    if(pending.size() >= maxPendingStamps) {
+        pending.erase(pending.begin());
+    }
+    pending.emplace_back(seq, stamp);
+}
+
+void LatencyProbe::presented(int seq) {
+    if(!enabled || pending.empty() || seq < 0) {
+        return;
+    }
+    uint32_t now = latencyStamp(chrono::steady_clock::now());
+    for(auto it = pending.begin(); it != pending.end();) {
+        if(compareSeqNum(it->first, seq) > 0) {
+            it++;
+            continue;
+        }
+        uint32_t us = now - it->second;
+        if(samples.size() < maxLatencySamples) {
+            samples.push_back(us);
+        }
+        int bucket = min((int)(us / 1000 / latencyBucketMs), latencyBuckets - 1);
+        buckets[bucket]++;
+        it = pending.erase(it);
+    }
+}
+
+// read off the histogram so the overlay can call it every frame, exportTo has the exact values
+float LatencyProbe::percentile(float fraction) const {
+    float total = 0;
+    for(float n : buckets) {
+        total += n;
+    }
+    if(total == 0) {
+        return 0;
+    }
+    float seen = 0;
+    for(int i = 0; i < latencyBuckets; i++) {
+        if(seen + buckets[i] >= fraction * total) {
+            float within = (fraction * total - seen) / buckets[i];
+            return (i + within) * latencyBucketMs;
+        }
+        seen += buckets[i];
+    }
+    return latencyBuckets * latencyBucketMs;
+}
+
+bool LatencyProbe::exportTo(const string& path) const {
+    ofstream file(path);
+    if(!file) {
+        return false;
+    }
+    file << "latency_us\n";
+    for(uint32_t us : samples) {
+        file << us << '\n';
+    }
+    return (bool)file;
+}
+
+void LatencyProbe::reset() {
+    pending.clear();
+    samples.clear();
+    fill(begin(buckets), end(buckets), 0.0f);
+}
@@ -0,0 +1,155 @@
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <log.h>
+
+using namespace std;
+
+// records per thread, a full ring drops new records instead of blocking
+constexpr size_t logRingSize = 1024;
+
+// Single producer single consumer ring owned by one logging thread
+struct logRing {
+    logRecord records[logRingSize];
+    atomic<size_t> head = 0;
+    atomic<size_t> tail = 0;
+    atomic<uint64_t> dropped = 0;
+    // set when the owning thread exits, the writer frees the ring once it is drained
+    atomic<bool> retired = false;
+};
+
+static mutex ringsLock;
+static vector<logRing*> rings;
+static atomic<bool> writerRunning = false;
+static thread writer;
+static FILE* output = stdout;
+static const auto logEpoch = chrono::steady_clock::now();
+
+static logRing* registerRing() {
+    logRing* ring = new logRing();
+    lock_guard<mutex> guard(ringsLock);
+    rings.push_back(ring);
+    return ring;
+}
+
+// hands the thread's ring back to the writer when the thread exits, so threads started
+// for every session do not leave a ring behind each
+struct ringOwner {
+    logRing* ring = registerRing();
+
+    ~ringOwner() {
+        ring->retired.store(true, memory_order_release);
+        ring = NULL;
+    }
+};
+
+static thread_local ringOwner localRing;
+
+uint64_t logNow() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - logEpoch).count();
+}
+
+logRecord* logClaim() {
+    // thread_local destructors that run after the owner's cannot log anymore
+    logRing* ring = localRing.ring;
+    if(!ring) {
+        return NULL;
+    }
+    size_t tail = ring->tail.load(memory_order_relaxed);
+    if(tail - ring->head.load(memory_order_acquire) >= logRingSize) {
+        ring->dropped++;
+        return NULL;
+    }
+    return &ring->records[tail % logRingSize];
+}
+
+void logCommit() {
+    logRing* ring = localRing.ring;
+    ring->tail.store(ring->tail.load(memory_order_relaxed) + 1, memory_order_release);
+}
+
+static void writeRecord(const logRecord& r) {
+    static const char levels[] = { 'D', 'I', 'W', 'E' };
+    char line[512];
+    int pos = snprintf(line, sizeof(line), "[%12.6f] %c ", r.ns / 1e9, levels[r.level & 3]);
+    int arg = 0;
+    for(const char* f = r.format; *f && pos < (int)sizeof(line) - 1; f++) {
+        if(f[0] == '{' && f[1] == '}' && arg < r.argCount) {
+            const logArg& a = r.args[arg++];
+            int room = sizeof(line) - pos;
+            switch(a.type) {
+                case logArg::INT:
+                    pos += snprintf(line + pos, room, "%lld", (long long)a.i);
+                    break;
+                case logArg::UINT:
+                    pos += snprintf(line + pos, room, "%llu", (unsigned long long)a.u);
+                    break;
+                case logArg::FLOAT:
+                    pos += snprintf(line + pos, room, "%g", a.d);
+                    break;
+                case logArg::TEXT:
+                    pos += snprintf(line + pos, room, "%s", r.text + a.u);
+                    break;
+            }
+            f++;
+        } else {
+            line[pos++] = *f;
+        }
+    }
+    pos = min(pos, (int)sizeof(line) - 2);
+    line[pos++] = '\n';
+    fwrite(line, 1, pos, output);
+}
+
+static void drain() {
+    lock_guard<mutex> guard(ringsLock);
+    for(auto it = rings.begin(); it != rings.end();) {
+        logRing* ring = *it;
+        // read before draining, a retired ring gets no more records
+        bool retired = ring->retired.load(memory_order_acquire);
+        size_t head = ring->head.load(memory_order_relaxed);
+        size_t tail = ring->tail.load(memory_order_acquire);
+        for(; head != tail; head++) {
+            writeRecord(ring->records[head % logRingSize]);
+        }
+        ring->head.store(head, memory_order_release);
+        uint64_t dropped = ring->dropped.exchange(0);
+        if(dropped > 0) {
+            fprintf(output, "[%12.6f] W %llu log records dropped\n", logNow() / 1e9, (unsigned long long)dropped);
+        }
+        if(retired) {
+            delete ring;
+            it = rings.erase(it);
+        } else {
+            it++;
+        }
+    }
+    fflush(output);
+}
+
+static void writeLoop() {
+    while(writerRunning) {
+        drain();
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    drain();
+}
+
+void logStart(FILE* out) {
+    if(writerRunning.exchange(true)) {
+        return;
+    }
+    output = out;
+    writer = thread(writeLoop);
+    atexit(logStop);
+}
+
+void logStop() {
+    if(!writerRunning.exchange(false)) {
+        return;
+    }
+    writer.join();
+}
@@ -3,161 +3,114 @@
 #include <chrono>
 #include <cstring>
 #include <iostream>
-#include <map>
-#include <mutex>
 #include <sstream>
+#include <stdexcept>
 #include <thread>
-#include <vector>
 
 // GUI
 #include <SDL2/SDL.h>
-#include <SDL2/SDL_net.h>
 #include <imgui_impl_sdl2.h>
 #include <imgui_impl_sdlrenderer2.h>
 
-// FFMPEG
-extern "C" {
-#include <libavcodec/avcodec.h>
-#include <libavformat/avformat.h>
-}
-
-// Encryption
-#include <openssl/evp.h>
-#include <openssl/aes.h>
+#include <capture.h>
+#include <latency.h>
+#include <log.h>
+#include <overlay.h>
+#include <perf.h>
+#include <protocol.h>
+#include <receiver.h>
+#include <reliableChannel.h>
+#include <sendQueue.h>
+#include <stats.h>
+#include <trace.h>
+#include <udpSocket.h>
 
 using namespace std;
 
-#define INBUF_SIZE 50000
 #define PORT 3478
-constexpr auto maxPacketCount = 256 * 60;
-#define maxByteVal 256
 
 // threads
 atomic<bool> run = true;
-mutex retransMutex;
 
 // SDL
 SDL_Window *screen;
 SDL_Renderer *renderer;
 SDL_Texture *texture;
 
-// FFMPEG
-const AVCodec *codec;
-AVCodecParserContext *parser;
-AVCodecContext *c = NULL;
-AVFrame *frame;
-uint8_t *data;
-size_t data_size;
-AVPacket *pkt;
 SDL_Rect rect;
 
 // sockets
-UDPsocket sock = NULL;
-UDPpacket *packet;
-SDLNet_SocketSet socket_set;
+UdpSocket sock;
+// longest the main loop sleeps while streaming, bounds input handling when no datagrams arrive
+constexpr chrono::milliseconds loopTick = chrono::milliseconds(10);
+// the stream counts as stopped after this long without a datagram
+constexpr chrono::seconds firstDatagramTimeout = chrono::seconds(30);
+constexpr chrono::seconds streamTimeout = chrono::seconds(5);
+// every outgoing datagram after the handshake goes through here
+SendQueue sendQueue(1024);
+// numbered input messages, the window has to divide maxPacketCount
+// each input datagram repeats up to 3 unacknowledged messages
+ReliableChannel inputChannel(sendQueue, 64 * 1024, 1024, 3);
 bool haveClient = false, firstReceive = true;
 
-enum sendPacketTypes {
-    NUMBERED = 1,
-    RETRANSMIT = 2,
-    UNNUMBERED = 3
+// frame reassembly, NACKs and decoding, input messages are tracked by inputChannel
+Receiver receiver;
+
+// mouse motion coalescing
+// 0 follows the measured stream frame rate, anything else is an explicit cap in Hz
+int motionSendHz = 0;
+constexpr double minMotionHz = 30.0;
+double streamFps = 60.0;
+chrono::time_point<chrono::steady_clock> lastPresent;
+struct pendingMotion {
+    bool dirty = false;
+    float x = 0;
+    float y = 0;
+    // first motion event since the last send, used as the input stamp
+    chrono::time_point<chrono::steady_clock> since;
+    chrono::time_point<chrono::steady_clock> lastSent;
 };
-
-/* ctx structures that libcrypto used to record encryption/decryption status */
-EVP_CIPHER_CTX* en = EVP_CIPHER_CTX_new();
-EVP_CIPHER_CTX* de = EVP_CIPHER_CTX_new();
-
-// Create 128 bit key and IV using key_data and 8 byte salt and initializes ctx objects
-int aes_init(string key_data, int key_data_len, unsigned char* salt, EVP_CIPHER_CTX* e_ctx,
-		EVP_CIPHER_CTX* d_ctx)
-{
-	int i, nrounds = 5;
-	unsigned char key[32], iv[32];
-
-	/*
-	 * Generate key & IV for AES 128 CBC mode. SHA1 digest is used to hash the supplied key material.
-	 */
-	i = EVP_BytesToKey(EVP_aes_128_cbc(), EVP_sha1(), salt, (unsigned char*) key_data.c_str(), key_data_len, nrounds, key, iv);
-
-	EVP_CIPHER_CTX_init(e_ctx);
-	EVP_EncryptInit_ex(e_ctx, EVP_aes_128_cbc(), NULL, key, iv);
-	EVP_CIPHER_CTX_init(d_ctx);
-	EVP_DecryptInit_ex(d_ctx, EVP_aes_128_cbc(), NULL, key, iv);
-
-	return 0;
-}
-
-// Apply aes-128 encryption based on key and iv values
-// All data going in & out is considered binary
-unsigned char* aes_encrypt(EVP_CIPHER_CTX* e, unsigned char* plaintext, int* len)
-{
-	/* max ciphertext len for a n bytes of plaintext is n + AES_BLOCK_SIZE -1 bytes */
-	int c_len = *len + AES_BLOCK_SIZE, f_len = 0;
-	unsigned char* ciphertext = new unsigned char[c_len];
-
-	/* allows reusing of 'e' for multiple encryption cycles */
-	EVP_EncryptInit_ex(e, NULL, NULL, NULL, NULL);
-
-	/* update ciphertext, c_len is filled with the length of ciphertext generated, *len is the size of plaintext in bytes */
-	EVP_EncryptUpdate(e, ciphertext, &c_len, plaintext, *len);
-
-	/* update ciphertext with the final remaining bytes */
-	EVP_EncryptFinal_ex(e, ciphertext + c_len, &f_len);
-
-	*len = c_len + f_len;
-	return ciphertext;
-}
-
-// Decrypt aes-128 encryption based on key and iv values
-unsigned char* aes_decrypt(EVP_CIPHER_CTX* e, unsigned char* ciphertext, int* len)
-{
-	/* plaintext will always be equal to or lesser than length of ciphertext*/
-	int p_len = *len, f_len = 0;
-	unsigned char* plaintext = new unsigned char[p_len];
-
-	EVP_DecryptInit_ex(e, NULL, NULL, NULL, NULL);
-	EVP_DecryptUpdate(e, plaintext, &p_len, ciphertext, *len);
-	EVP_DecryptFinal_ex(e, plaintext + p_len, &f_len);
-
-	*len = p_len + f_len;
-	return plaintext;
-}
-
-
-
-//retransmission
-const chrono::duration<int, milli> retransmitTimeout = 300ms;
-struct retransmitRequest {
-    chrono::time_point<chrono::steady_clock> start;
-    chrono::duration<int, milli> elapsed = retransmitTimeout;
-    bool isFrame = false;
-    string data;
+pendingMotion motion;
+
+// input to photon latency, measured by receiver.latency
+string latencyFile = "latency.csv";
+
+// in-session stats overlay, toggled with F12
+bool showOverlay = false;
+
+// F11 writes the trace ring here
+string traceFile = "trace.json";
+
+// command line, see usage()
+struct clientOptions {
+    // no window, connects straight away and logs stats instead of drawing them
+    bool headless = false;
+    // connects on startup when set
+    string host;
+    int port = PORT;
+    bool p2p = true;
+    // seconds, 0 runs until the stream stops
+    int duration = 0;
+    // seconds between stats lines in headless mode
+    int statsEvery = 1;
+    // headless mode writes raw I420 frames here, empty discards them
+    string output;
+    // hardware counters around the receive stages, reported with the summary
+    bool perf = false;
+    // socket receive buffer in bytes, 0 keeps the system default
+    int receiveBuffer = defaultReceiveBuffer;
+    // receive through io_uring rather than epoll where it is available
+    bool uring = false;
+    // UDP_GRO and UDP_SEGMENT where the kernel has them
+    bool offload = true;
 };
-map<int, retransmitRequest> retransmits;
+clientOptions opts;
+FILE* frameSink = NULL;
 
-char backupBuf[maxPacketCount * 30];
-int backupLens[maxPacketCount];
-int hpCount = 0;
-int lpCount = 0;
-vector<int> unorderedPack;
-
-
-// read buffer
-enum receivePacketType {
-    FRAME = 0,
-    INPUTRETRANSMIT = 1,
-    INPUTRETRANSMITIND = 2
-};
-struct recvPacket {
-    bool transmitRequested = false;
-    int dataLen = -1;
-    uint8_t data[1500];
-    receivePacketType type = FRAME;
-    int visited = -1;
-};
-recvPacket buf[maxPacketCount];
-/* int visited[maxPacketCount]; */
-/* bool retransmitRequests [maxPacketCount]; */
+// raw received datagrams for offline analysis and replay
+PacketCapture capture;
+bool captureEnabled = false;
+string captureFile = "capture.sscap";
 
 
 void unreliableSendPacket(string toSend, bool retransmit);
@@ -166,45 +119,90 @@ void clean() {
     SDL_DestroyTexture(texture);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(screen);
-    av_packet_free(&pkt);
-    av_frame_free(&frame);
-    avcodec_free_context(&c);
 }
 
-void display(AVCodecContext* ctx, AVPacket* pkt, AVFrame* frame, SDL_Rect* rect, SDL_Texture* texture, SDL_Renderer* renderer, double fpsrend) {
-#if AV_VERSION_MAJOR(AVCODEC_VERSION) < 60
-    int framenum = ctx->frame_number;
-#else
-    int framenum = ctx->frame_num;
-#endif
-    SDL_UpdateYUVTexture(texture, rect,
-            frame->data[0], frame->linesize[0],
-            frame->data[1], frame->linesize[1],
-            frame->data[2], frame->linesize[2]);
+void display(AVFrame* frame) {
+    SessionStats& stats = receiver.stats;
+    LatencyProbe& latency = receiver.latency;
+    auto start = chrono::steady_clock::now();
+    uint32_t traceId = frame->pts != AV_NOPTS_VALUE ? frame->pts : 0;
+    {
+        TRACE_SPAN("upload", traceId);
+        SDL_UpdateYUVTexture(texture, &rect,
+                frame->data[0], frame->linesize[0],
+                frame->data[1], frame->linesize[1],
+                frame->data[2], frame->linesize[2]);
+    }
     SDL_RenderClear(renderer);
-    SDL_RenderCopy(renderer, texture, NULL, rect);
-    SDL_RenderPresent(renderer);
-}
-
-static void decode(AVCodecContext *dec_ctx, AVFrame *frame, AVPacket *pkt)
-{
-    int ret;
+    SDL_RenderCopy(renderer, texture, NULL, &rect);
+    if(showOverlay || latency.enabled) {
+        TRACE_SPAN("overlay", traceId);
+        drawSessionUi(stats, latency, latencyFile, showOverlay);
+    }
+    {
+        TRACE_SPAN("present", traceId);
+        SDL_RenderPresent(renderer);
+    }
+    if(frame->pts != AV_NOPTS_VALUE) {
+        latency.presented(frame->pts);
+    }
 
-    ret = avcodec_send_packet(dec_ctx, pkt);
-    if (ret < 0) {
-        exit(1);
+    // smoothed presentation rate, used to pace mouse motion updates
+    auto now = chrono::steady_clock::now();
+    stats.presented(chrono::duration_cast<chrono::microseconds>(now - start));
+    if(lastPresent.time_since_epoch().count() != 0) {
+        double dt = chrono::duration<double>(now - lastPresent).count();
+        if(dt > 0) {
+            streamFps = streamFps * 0.9 + (1.0 / dt) * 0.1;
+        }
     }
+    lastPresent = now;
+}
 
-    while (ret >= 0) {
-        ret = avcodec_receive_frame(dec_ctx, frame);
-        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
-            return;
-        else if (ret < 0) {
-            exit(1);
+// stands in for display() in headless mode
+void discardFrame(AVFrame* frame) {
+    auto start = chrono::steady_clock::now();
+    if(frameSink) {
+        for(int plane = 0; plane < 3; plane++) {
+            int width = plane == 0 ? frame->width : (frame->width + 1) / 2;
+            int height = plane == 0 ? frame->height : (frame->height + 1) / 2;
+            for(int y = 0; y < height; y++) {
+                fwrite(frame->data[plane] + (size_t)y * frame->linesize[plane], 1, width, frameSink);
+            }
         }
+    }
+    if(frame->pts != AV_NOPTS_VALUE) {
+        receiver.latency.presented(frame->pts);
+    }
+    receiver.stats.presented(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start));
+}
 
-        display(c, pkt, frame, &rect, texture, renderer, 30.0);
-        fflush(stdout);
+void logStats() {
+    const SessionStats& stats = receiver.stats;
+    LOG_INFO("{} Mbit/s {} pkt/s loss {} recovered {}", stats.bitrateMbps.last, stats.packetRate.last,
+            stats.lossRate.last, stats.recoveryRate.last);
+    LOG_INFO("fps {} decode {} ms rtt {} ms jitter {} ms", stats.fps.last, stats.decodeMs.last,
+            stats.rttMs.last, stats.jitter.last);
+    LOG_INFO("estimated bandwidth {} Mbit/s", stats.estimateMbps.last);
+}
+
+void logSummary() {
+    receiver.stats.sendDrops = sendQueue.dropped;
+    const SessionStats& stats = receiver.stats;
+    LOG_INFO("{} packets {} bytes {} frames", stats.packets, stats.bytes, stats.frames);
+    LOG_INFO("{} lost {} recovered {} NACKs", stats.lost, stats.recovered, stats.nacks);
+    LOG_INFO("{} NACKs suppressed {} packets skipped {} keyframes requested", stats.nacksSuppressed, stats.skipped,
+        stats.keyframeRequests);
+    LOG_INFO("{} datagrams dropped by the socket, {} by the send queue", stats.kernelDrops, stats.sendDrops);
+}
+
+// the counters run for the whole process, so they are divided by every session's packets and frames
+uint64_t perfPackets = 0;
+uint64_t perfFrames = 0;
+
+void logPerf() {
+    if(perfActive()) {
+        perfReport(perfPackets + receiver.stats.packets, perfFrames + receiver.stats.frames);
     }
 }
 
@@ -214,12 +212,7 @@ void keepAlive() {
         if(haveClient) {
             string opcode = "";
             opcode += (char)0;
-            packet->len = opcode.length() + 1;
-            memcpy(packet->data, opcode.c_str(), packet->len);
-            int len = SDLNet_UDP_Send(sock, -1, packet);
-            if(len == 0) {
-                cout << SDLNet_GetError();
-            }
+            sendQueue.push((const uint8_t*)opcode.c_str(), opcode.length() + 1);
         }
     }
 }
@@ -227,49 +220,9 @@ void keepAlive() {
 void handleRetransmit() { 
     while(run) {
         if(haveClient) {
-            chrono::duration<int, milli> min = retransmitTimeout;
-            if(!retransmits.empty()) {
-                retransMutex.lock();
-                for(auto it = retransmits.begin(); it != retransmits.end(); it++) {
-                    if(it->second.elapsed < min) {
-                        min = it->second.elapsed;
-                    }
-                }
-                cout << "Sleeping for " << min.count() << endl;
-                retransMutex.unlock();
-                this_thread::sleep_for(min);
-                auto end = chrono::steady_clock::now();
-                retransMutex.lock();
-                for(auto it = retransmits.begin(); it != retransmits.end(); it++) {
-                    auto passed = end - it->second.start;
-                    it->second.elapsed -= chrono::milliseconds(passed.count() / 1000000);
-                    if(it->second.elapsed.count() <= 0) {
-                        cout << "Timer expired for " << it->first;
-                        if(!it->second.isFrame) {
-                            stringstream send;
-                            send << (char)(it->first / maxByteVal) << (char)(it->first % maxByteVal);
-                            for(int j = 0; j < backupLens[it->first]; j++) {
-                                send << (char)(backupBuf[it->first*30 + j]);
-                            }
-                            for(int i = 0; i < send.str().length(); i++) {
-                                cout << (int)((uint8_t)send.str()[i]) << " ";
-                            }
-                            cout << endl;
-                            unreliableSendPacket(send.str(), true);
-                        } else {
-                            stringstream send;
-                            send << '7';
-                            send << (char)(it->first / maxByteVal) << (char)(it->first % maxByteVal);
-                            unreliableSendPacket(send.str(), false);
-                        }
-                        it->second.elapsed = retransmitTimeout;
-                        it->second.start = chrono::steady_clock::now();
-                    }
-                }
-                retransMutex.unlock();
-            } else {
-                this_thread::sleep_for(min);
-            }
+            chrono::milliseconds wait = min(chrono::milliseconds(inputChannel.resendDue()), receiver.resendNacks());
+            LOG_DEBUG("Sleeping for {}", wait.count());
+            this_thread::sleep_for(wait);
         } else {
             SDL_Delay(200);
         }
@@ -278,29 +231,8 @@ void handleRetransmit() {
 
 
 void sendPacket(string toSend) {
-    stringstream send;
-    // 1 for first time numbered transmission
-    send << (char)NUMBERED << (char)hpCount << (char)lpCount << toSend;
-    packet->len = send.str().length() + 1;
-    if(packet->len < 4) {
-        cout << "Small packet len: " << send.str().length() << " " << send.str() << endl;
-    }
-    memcpy(packet->data, send.str().c_str(), packet->len);
-    memcpy(&backupBuf[(hpCount * maxByteVal + lpCount) * 30], toSend.c_str(), packet->len - 3);
-    backupLens[hpCount * maxByteVal + lpCount] = packet->len;
-
-    lpCount++;
-    if(lpCount > 255) {
-        lpCount = 0;
-        hpCount++;
-        if(hpCount > 59) {
-            hpCount = 0;
-        }
-    }
-
-    int len = SDLNet_UDP_Send(sock, -1, packet);
-    if(len == 0) {
-        cout << SDLNet_GetError();
+    if(!inputChannel.send(toSend)) {
+        LOG_WARN("Dropped input message of length {}", toSend.length());
     }
 }
 
@@ -313,82 +245,201 @@ void unreliableSendPacket(string toSend, bool retransmit) {
         // 2 for data retransmission
         send << (char)RETRANSMIT << toSend;
     }
-    packet->len = send.str().length() + 1;
-    memcpy(packet->data, send.str().c_str(), packet->len);
-    int len = SDLNet_UDP_Send(sock, -1, packet);
-    if(len == 0) {
-        cout << SDLNet_GetError();
-    }
+    string out = send.str();
+    sendQueue.push((const uint8_t*)out.c_str(), out.length() + 1);
 }
 
-// compares two 16 bit sequence numbers
-// returns -1 for num1 < num2, 0 for equal, and 1 for greater
-int compareSeqNum(uint16_t num1, uint16_t num2) {
-    if(num1 == num2) 
-        return 0;
-    
-    if (num1 < num2 && num2 - num1 < (maxPacketCount) / 2 ||
-        num1 > num2 && num1 - num2 > (maxPacketCount) / 2) {
-        return -1;
+// sends the latest coalesced mouse position once the send interval has passed
+// force skips the interval check so button events are preceded by the current position
+void flushMotion(bool force) {
+    if(!motion.dirty) {
+        return;
     }
-
-    return 1;
+    auto now = chrono::steady_clock::now();
+    double hz = motionSendHz > 0 ? motionSendHz : max(streamFps, minMotionHz);
+    if(!force && now - motion.lastSent < chrono::duration<double>(1.0 / hz)) {
+        return;
+    }
+    string msg = "1" + to_string(motion.x) + "a" + to_string(motion.y);
+    inputChannel.sendUnreliable(msg, motion.since);
+    motion.dirty = false;
+    motion.lastSent = now;
 }
 
-int main(int argc, char **argv) {
-
-    thread alive(keepAlive);
-    thread retransmit(handleRetransmit);
-
-    // 8 bytes of salt data
-    unsigned int salt[] = { 12345, 54321 };
-
-    string key_data = "2B28AB097EAEF7CF15D2154F16A6883C";
-    int key_data_len, i;
-
-    key_data_len = key_data.length();
+void usage() {
+    cout << "usage: remoteDesktopClient [--host ip] [--port 3478] [--p2p 1] [--headless] [--duration s]" << endl
+        << "    [--stats-every s] [--output frames.yuv] [--latency] [--capture file.sscap] [--perf]" << endl
+        << "    [--playout-delay ms] [--rcvbuf bytes] [--socket epoll|io_uring]" << endl
+        << "    [--offload 0|1]" << endl;
+}
 
-    /* gen key and iv. init the cipher ctx object */
-    if (aes_init(key_data, key_data_len, (unsigned char*)&salt, en, de)) {
-	    printf("Couldn't initialize AES cipher\n");
-	    return -1;
+bool parseOptions(int argc, char** argv) {
+    // stoi throws invalid_argument or out_of_range on values that are not numbers
+    try {
+        for(int i = 1; i < argc; i++) {
+            string arg = argv[i];
+            if(arg == "--headless") {
+                opts.headless = true;
+                continue;
+            }
+            if(arg == "--latency") {
+                receiver.latency.enabled = true;
+                continue;
+            }
+            if(arg == "--perf") {
+                opts.perf = true;
+                continue;
+            }
+            if(i + 1 >= argc) {
+                return false;
+            }
+            string value = argv[++i];
+            if(arg == "--host") {
+                opts.host = value;
+            } else if(arg == "--port") {
+                opts.port = stoi(value);
+            } else if(arg == "--p2p") {
+                opts.p2p = stoi(value) != 0;
+            } else if(arg == "--duration") {
+                opts.duration = stoi(value);
+            } else if(arg == "--stats-every") {
+                opts.statsEvery = stoi(value);
+            } else if(arg == "--output") {
+                opts.output = value;
+            } else if(arg == "--socket") {
+                if(value != "epoll" && value != "io_uring") {
+                    return false;
+                }
+                opts.uring = value == "io_uring";
+            } else if(arg == "--offload") {
+                opts.offload = stoi(value) != 0;
+            } else if(arg == "--rcvbuf") {
+                opts.receiveBuffer = stoi(value);
+            } else if(arg == "--playout-delay") {
+                receiver.playoutDelay = chrono::milliseconds(stoi(value));
+            } else if(arg == "--capture") {
+                captureEnabled = true;
+                captureFile = value;
+            } else {
+                return false;
+            }
+        }
+    } catch(const logic_error&) {
+        return false;
     }
+    return !opts.headless || !opts.host.empty();
+}
 
-    // ffmpeg setup
-
-    pkt = av_packet_alloc();
-    if (!pkt) {
-        cout << "error allocating packet" << endl;
+// handshake with the server, which answers with the address to stream with
+bool connectToServer(const char* host, int port, bool p2p) {
+    peerAddress server;
+    if (!UdpSocket::resolve(host, port, server)) {
+        LOG_ERROR("could not resolve {}", host);
+        return false;
+    }
+    sock.preferUring = opts.uring;
+    sock.offload = opts.offload;
+    if (!sock.open()) {
         exit(1);
     }
-
-    codec = avcodec_find_decoder(AV_CODEC_ID_H264);
-    if(!codec) {
-	    cout << "error finding codec" << endl;
-	    exit(1);
+    LOG_INFO("receiving with {}, GRO {}, GSO {}", sock.backend(),
+        sock.receiveCoalescing() ? "on" : "off", sock.sendSegmentation() ? "on" : "off");
+    // keyframes arrive as bursts that overflow the default buffer while a frame decodes
+    if(opts.receiveBuffer > 0) {
+        int granted = sock.setReceiveBuffer(opts.receiveBuffer);
+        if(granted < opts.receiveBuffer) {
+            LOG_WARN("receive buffer is {} bytes, raise net.core.rmem_max for {}", granted, opts.receiveBuffer);
+        }
     }
-
-    parser = av_parser_init(codec->id);
-    if (!parser) {
-        cout << "Error finding parser" << endl;
-        exit(1);
+    if(!sock.enableDropCounter()) {
+        LOG_WARN("SO_RXQ_OVFL unavailable, kernel drops are not counted");
     }
-
-    c = avcodec_alloc_context3(codec);
-    if (!c) {
-        cout << "Could not allocate video context memory" << endl;
-        exit(1);
+    // arrival times from the kernel keep decode and render stalls out of jitter and bandwidth
+    if(!sock.enableTimestamps()) {
+        LOG_WARN("SO_TIMESTAMPNS unavailable, arrivals are timed when the loop reads them");
     }
-
-    if (avcodec_open2(c, codec, NULL) < 0) {
-        cout << "Could not open codec" << endl;
-        exit(1);
+    static const uint8_t data[] = "0";
+    sock.sendTo(data, sizeof(data), server);
+    datagram answer;
+    int count = 0;
+    while(sock.receiveBatch(&answer, 1) <= 0 && count < 5) {
+        sock.wait(chrono::milliseconds(500));
+        count++;
+    }
+    if(count >= 5) {
+        LOG_WARN("no answer from {}:{}", host, port);
+        sock.close();
+        return false;
+    }
+    size_t addressLen = strnlen((char*)answer.data, answer.len);
+    string ipPort = string((char*)answer.data, addressLen);
+    // servers that only know the original datagram formats answer with the address alone
+    uint8_t capabilities = addressLen + 1 < (size_t)answer.len ? answer.data[addressLen + 1] : 0;
+
+    LOG_INFO("{}", ipPort);
+    peerAddress streamPeer;
+    if (!UdpSocket::resolve(ipPort.substr(0, ipPort.find(":")).c_str(), stoi(ipPort.substr(ipPort.find(":") + 1)), streamPeer)) {
+        LOG_ERROR("could not resolve {}", ipPort);
+    } else {
+        LOG_INFO("setting peer address and port");
+        if(p2p) {
+            server = streamPeer;
+        }
     }
+    sock.setPeer(server);
+    sock.setTimer(loopTick);
+    sendQueue.open(&sock);
+    LOG_INFO("server capabilities {}", (int)capabilities);
+    inputChannel.bundleInput = capabilities & BUNDLEDINPUT;
+    inputChannel.stampInput = receiver.latency.enabled && (capabilities & STAMPEDINPUT);
+    if(receiver.latency.enabled && !(capabilities & STAMPEDINPUT)) {
+        LOG_WARN("server does not take input stamps, latency is not measured");
+    }
+    receiver.batchAcks = capabilities & BATCHEDACKS;
+    receiver.sendEstimates = capabilities & BANDWIDTHESTIMATES;
+    receiver.sendReports = capabilities & RECEIVERREPORTS;
+    receiver.requestKeyframes = capabilities & KEYFRAMEREQUESTS;
+    if(captureEnabled) {
+        capture.open(captureFile, capabilities);
+    }
+    // published last, keepAlive and handleRetransmit push to the queue and read the options above
+    haveClient = true;
+    return true;
+}
 
-    frame = av_frame_alloc();
-    if (!frame) {
-        cout << "could not allocate video frame" << endl;
-        exit(1);
+int main(int argc, char **argv) {
+
+    if(!parseOptions(argc, argv)) {
+        usage();
+        return 1;
+    }
+    logStart(stdout);
+
+    receiver.sendControl = [](const string& msg) {
+        unreliableSendPacket(msg, false);
+    };
+    receiver.present = opts.headless ? discardFrame : display;
+    receiver.inputControl = [](const uint8_t* data, int len) {
+        if (data[0] == INPUTACK) {
+            int index = (data[1]) * maxByteVal + data[2];
+            LOG_DEBUG("ack received {}", index);
+            inputChannel.ack(index);
+        } else if (len >= 7) {
+            int next = (data[1]) * maxByteVal + data[2];
+            uint32_t sack = (uint32_t)data[3] << 24 | (uint32_t)data[4] << 16 |
+                (uint32_t)data[5] << 8 | data[6];
+            inputChannel.ackCumulative(next, sack);
+        }
+    };
+    receiver.inputRetransmit = [](int seq) {
+        inputChannel.retransmit(seq);
+    };
+    if (!receiver.init()) {
+        return -1;
+    }
+    // the receive path runs on this thread
+    if(opts.perf) {
+        perfStart();
     }
 
     // sdl setup
@@ -396,71 +447,75 @@ int main(int argc, char **argv) {
         cout << "SDL_Init: " << SDL_GetError();
         exit(1);
     }
-    if (SDLNet_Init() == -1) {
-        cout << "SDLNet_Init: " << SDLNet_GetError();
-        exit(1);
-    }
 
-    screen = SDL_CreateWindow("screenShareApp", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-            1280, 720, SDL_WINDOW_OPENGL);
+    if(opts.headless) {
+        if(!opts.output.empty()) {
+            frameSink = fopen(opts.output.c_str(), "wb");
+            if(!frameSink) {
+                LOG_ERROR("could not open {}", opts.output);
+                return 1;
+            }
+        }
+    } else {
+        screen = SDL_CreateWindow("screenShareApp", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                1280, 720, SDL_WINDOW_OPENGL);
+
+        renderer = SDL_CreateRenderer(screen, -1, SDL_RENDERER_ACCELERATED);
+        if (!renderer) {
+            clean();
+            SDL_Quit();
+            return -1;
+        }
+        texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_IYUV,
+                SDL_TEXTUREACCESS_STREAMING | SDL_TEXTUREACCESS_TARGET,
+                1920, 1080);
+        if (!texture) {
+            clean();
+            SDL_Quit();
+            return -1;
+        }
 
-    renderer = SDL_CreateRenderer(screen, -1, SDL_RENDERER_ACCELERATED);
-    if (!renderer) {
-        clean();
-        SDL_Quit();
-        return -1;
-    }
-    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_IYUV,
-            SDL_TEXTUREACCESS_STREAMING | SDL_TEXTUREACCESS_TARGET,
-            1920, 1080);
-    if (!texture) {
-        clean();
-        SDL_Quit();
-        return -1;
+        rect.x = 0;
+        rect.y = 0;
+        rect.w = 1920;
+        rect.h = 1080;
+
+        // IMGUI setup
+        IMGUI_CHECKVERSION();
+        ImGui::CreateContext();
+        ImGuiIO& io = ImGui::GetIO(); (void)io;
+        ImGui_ImplSDL2_InitForSDLRenderer(screen, renderer);
+        ImGui_ImplSDLRenderer2_Init(renderer);
     }
 
-    rect.x = 0;
-    rect.y = 0;
-    rect.w = 1920;
-    rect.h = 1080;
-
-    // IMGUI setup
-    IMGUI_CHECKVERSION();
-    ImGui::CreateContext();
-    ImGuiIO& io = ImGui::GetIO(); (void)io;
-    ImGui_ImplSDL2_InitForSDLRenderer(screen, renderer);
-    ImGui_ImplSDLRenderer2_Init(renderer);
+    // started only once nothing above can return early and leave them joinable
+    thread alive(keepAlive);
+    thread retransmit(handleRetransmit);
 
     bool done = false;
     SDL_Event evt;
-    uint32_t windowID = SDL_GetWindowID(screen);
 
     // sockets
-    int len = 0;
-    packet = SDLNet_AllocPacket(INBUF_SIZE);
-    UDPpacket *recv = SDLNet_AllocPacket(INBUF_SIZE);
-    socket_set = SDLNet_AllocSocketSet(1);
+    datagram batch[socketBatch];
+    chrono::time_point<chrono::steady_clock> lastDatagram;
 
     //IMGUI state variables
     char port[20] = ""; 
     char ipToTry[30] = "167.234.216.217";
     static int p2p = 1;
 
-    // for tracking position in packet queue
-    int prevIndex = -1, index = -1;
-    int packetPos = 0;
-
-    retransMutex.lock();
-    retransmits.clear();
-    retransMutex.unlock();
-    if(socket_set == NULL) {
-        cout << "Could not allocate socket set";
-        exit(1);
-    }
     bool submit = false;
+    int exitCode = 0;
+    chrono::time_point<chrono::steady_clock> connectedAt, nextStatsLine;
+    if(!opts.host.empty()) {
+        snprintf(ipToTry, sizeof(ipToTry), "%s", opts.host.c_str());
+        snprintf(port, sizeof(port), "%d", opts.port);
+        p2p = opts.p2p;
+        submit = true;
+    }
 
     while (!done) {
-        while (SDL_PollEvent(&evt)) {
+        while (!opts.headless && SDL_PollEvent(&evt)) {
             ImGui_ImplSDL2_ProcessEvent(&evt);
             switch(evt.type) {
                 case SDL_QUIT:
@@ -468,6 +523,16 @@ int main(int argc, char **argv) {
                     break;
 
                 case SDL_KEYDOWN: {
+                    if(evt.key.keysym.sym == SDLK_F12) {
+                        showOverlay = !showOverlay;
+                        break;
+                    }
+                    if(evt.key.keysym.sym == SDLK_F11) {
+                        if(traceDump(traceFile)) {
+                            LOG_INFO("trace written to {}", traceFile);
+                        }
+                        break;
+                    }
                     if(haveClient) {
                         // '0' used for keydown events
                         int c = evt.key.keysym.sym;
@@ -477,6 +542,9 @@ int main(int argc, char **argv) {
                 }
 
                 case SDL_KEYUP: {
+                    if(evt.key.keysym.sym == SDLK_F12 || evt.key.keysym.sym == SDLK_F11) {
+                        break;
+                    }
                     if(haveClient) {
                         // '6' used for keyup events
                         int c = evt.key.keysym.sym;
@@ -488,8 +556,13 @@ int main(int argc, char **argv) {
 
                     if(haveClient) {
                         if(evt.motion.x >= 0 && evt.motion.y >= 0 && evt.motion.x <=1920 && evt.motion.y<=1080) {
-                            string motion = "1" + to_string((float) evt.motion.x / 1920) + "a" + to_string((float) evt.motion.y / 1080);
-                            unreliableSendPacket(motion, false);
+                            // only the latest position matters, flushMotion sends it at the paced rate
+                            motion.x = (float) evt.motion.x / 1920;
+                            motion.y = (float) evt.motion.y / 1080;
+                            if(!motion.dirty) {
+                                motion.since = chrono::steady_clock::now();
+                            }
+                            motion.dirty = true;
                         }
                     }
                     break;
@@ -498,16 +571,17 @@ int main(int argc, char **argv) {
                 case SDL_MOUSEBUTTONDOWN: {
 
                     if(haveClient) {
+                        flushMotion(true);
                         string opcode;
                         switch(evt.button.button) {
                             case SDL_BUTTON_LEFT: {
                                 sendPacket("2");
-                                cout << "leftDown" << endl;
+                                LOG_DEBUG("leftDown");
                                 break;
                             }
                             case SDL_BUTTON_RIGHT: {
                                 sendPacket("3");
-                                cout << "rightDown" << endl;
+                                LOG_DEBUG("rightDown");
                                 break;
                             }
                         }
@@ -516,16 +590,17 @@ int main(int argc, char **argv) {
                 }
                 case SDL_MOUSEBUTTONUP: {
                     if(haveClient) {
+                        flushMotion(true);
                         string opcode;
                         switch(evt.button.button) {
                             case SDL_BUTTON_LEFT: {
                                 sendPacket("4");
-                                cout << "leftup" << endl;
+                                LOG_DEBUG("leftup");
                                 break;
                             }
                             case SDL_BUTTON_RIGHT: {
                                 sendPacket("5");
-                                cout << "rightup" << endl;
+                                LOG_DEBUG("rightup");
                                 break;
                             }
                         }
@@ -535,7 +610,26 @@ int main(int argc, char **argv) {
             }
         }
 
-        if(!haveClient) {
+        if(haveClient) {
+            flushMotion(false);
+
+            auto now = chrono::steady_clock::now();
+            if(receiver.stats.due(now)) {
+                // frame NACKs are answered more often than input is resent, prefer their round trips
+                auto rtt = receiver.srtt().count() ? receiver.srtt() : inputChannel.srtt();
+                receiver.stats.tick(now, receiver.nacksOutstanding(), rtt);
+                receiver.stats.sendDrops = sendQueue.dropped;
+            }
+            if(opts.headless && now >= nextStatsLine) {
+                logStats();
+                nextStatsLine = now + chrono::seconds(opts.statsEvery);
+            }
+            if(opts.duration > 0 && now - connectedAt >= chrono::seconds(opts.duration)) {
+                done = true;
+            }
+        }
+
+        if(!opts.headless && !haveClient) {
             SDL_RenderSetLogicalSize(renderer, 0, 0);
             ImGui_ImplSDLRenderer2_NewFrame();
             ImGui_ImplSDL2_NewFrame();
@@ -552,6 +646,8 @@ int main(int argc, char **argv) {
             ImGui::InputText("Port", port, IM_ARRAYSIZE(port));
             ImGui::RadioButton("UDP P2P", &p2p, 1); 
             ImGui::RadioButton("UDP TURN", &p2p, 0);
+            ImGui::Checkbox("Measure input latency", &receiver.latency.enabled);
+            ImGui::Checkbox("Capture packets", &captureEnabled);
             if (ImGui::Button("Submit")) {
                 submit = true;
                 /* ImGui::OpenPopup("Disconnect"); */
@@ -575,307 +671,97 @@ int main(int argc, char **argv) {
 
             SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
             SDL_RenderClear(renderer);
-        } else {
+        } else if(!opts.headless) {
             /* ImGui::Image((void*)texture, ImVec2(10, 10)); */
             SDL_RenderSetLogicalSize(renderer, 1920, 1080);
         }
 
         if(submit) {
             submit = false;
-            IPaddress ip;
-            long temp = strtol(port, NULL, 10);
-            if (SDLNet_ResolveHost(&ip, ipToTry, (uint16_t) PORT) == -1) {
-                cout << "SDLNet_ResolveHost: " << SDLNet_GetError();
-            } else {
-                sock = SDLNet_UDP_Open(0);
-                if (!sock) {
-                    cout << "SDLNet_UDP_Open: " << SDLNet_GetError();
-                    exit(1);
-                } else {
-                    static const char* data = "0";
-                    packet->len = strlen(data) + 1;
-                    packet->address = ip;
-                    memcpy(packet->data, data, packet->len);
-                    SDLNet_UDP_Send(sock, -1, packet);
-                    int count = 0;
-                    while(SDLNet_UDP_Recv(sock, recv) <= 0 && count < 5) {
-                        SDL_Delay(500);
-                        count++;
-                    }
-                    if(count < 5) {
-                        haveClient = true;
-                        recv->data[recv->len] = '\0';
-                        string ipPort = string((char*)recv->data);
-
-                        cout << ipPort << endl;
-                        if (SDLNet_ResolveHost(&ip, ipPort.substr(0, ipPort.find(":")).c_str(), (uint16_t) stoi(ipPort.substr(ipPort.find(":") + 1))) == -1) {
-                            cout << "SDLNet_ResolveHost: " << SDLNet_GetError();
-                        } else {
-                            cout << "setting peer address and port" << endl;
-                            if(p2p == 1) {
-                                packet->address = ip;
-                            }
-                        }
-                        SDLNet_UDP_AddSocket(socket_set, sock);
-
-                    }
-                }
+            long portNum = strtol(port, NULL, 10);
+            if(connectToServer(ipToTry, portNum > 0 ? portNum : PORT, p2p == 1)) {
+                connectedAt = lastDatagram = chrono::steady_clock::now();
+                nextStatsLine = connectedAt + chrono::seconds(opts.statsEvery);
+            } else if(opts.headless) {
+                exitCode = 1;
+                done = true;
             }
         }
         /* read the buffer from sock */
         if(haveClient) {
-            int ready;
-            if(firstReceive) {
-                ready = SDLNet_CheckSockets(socket_set, 30000);
-                if(ready > 0) {
-                    firstReceive = false;
+            // the socket's timer wakes the loop every loopTick for input and stats
+            int events = sock.wait(firstReceive ? firstDatagramTimeout : streamTimeout);
+            auto now = chrono::steady_clock::now();
+            int count = 0;
+            if(events & SOCKET_READABLE) {
+                uint64_t recvStart = traceEnabled ? traceNow() : 0;
+                count = sock.receiveBatch(batch, socketBatch);
+                if(recvStart && count > 0 && batch[0].len >= 3) {
+                    traceRecord("recv", recvStart, traceNow(), batch[0].data[1] * maxByteVal + batch[0].data[2]);
                 }
-            } else {
-                ready = SDLNet_CheckSockets(socket_set, 5000);
-            }
-            if(ready > 0) {
-                SDLNet_UDP_Recv(sock, recv);
-                /* cout << "length: " << recv->len << endl; */
-                /* cout << recv->data << endl; */
-                if((uint8_t) recv->data[0] == 2) {
-
-                } else if ((uint8_t) recv->data[0] == 4) {
-                    int index = (recv->data[1]) * maxByteVal + recv->data[2];
-                    cout << "ack received" << index << endl;
-                    retransMutex.lock();
-                    retransmits.erase(index);
-                    retransMutex.unlock();
-                } else {
-                    uint8_t *data = &recv->data[3];
-                    size_t   data_size = recv->len - 3;
-                    int ret;
-
-                    index = (int) ((recv->data[1]) * maxByteVal + (recv->data[2]));
-                    cout << index << endl;
-                    if(recv->data[0] == 1) {
-                        retransMutex.lock();
-                        buf[index].transmitRequested = false;
-                        retransmits.erase(index);
-                        retransMutex.unlock();
-                        stringstream send;
-                        send << '9' << (char)(recv->data[1]) << (char)(recv->data[2]);
-                        unreliableSendPacket(send.str(), false);
-                        cout << "ack sent: " << index << endl;
-                    }
-                    if(compareSeqNum(index, packetPos) >= 0) {
-
-			int len = data_size;
-			unsigned char* plaintext = aes_decrypt(de, (unsigned char*)data, &len);
-
-                        memcpy(&buf[index].data, plaintext, len);
-                        buf[index].visited = len;
-
-                        auto match = find(unorderedPack.begin(), unorderedPack.end(), index);
-                        if (match != unorderedPack.end()) {
-                            unorderedPack.erase(match);
-                        } else {
-                            if (unorderedPack.size() > 0) {
-                                auto minVal = min_element(unorderedPack.begin(), unorderedPack.end());
-                                int unorderedDiff = min(abs(index - *minVal), maxPacketCount - abs(index - *minVal));
-                                if(unorderedDiff > 5 || unorderedPack.size() >= 5) {
-                                    for (auto it = unorderedPack.begin(); it != unorderedPack.end(); it++) {
-                                        if(!buf[*it].transmitRequested) {
-                                            stringstream send;
-                                            send << '7';
-                                            send << (char)(*it / maxByteVal);
-                                            send << (char)(*it % maxByteVal);
-                                            buf[*it].transmitRequested = true;
-                                            unreliableSendPacket(send.str(), false);
-                                            retransmitRequest req;
-                                            req.start = chrono::steady_clock::now();
-                                            req.isFrame = true;
-                                            req.data = send.str();
-                                            retransMutex.lock();
-                                            retransmits.emplace(*it, req);
-                                            retransMutex.unlock();
-                                        }
-                                    }
-                                    unorderedPack.clear();
-                                }
-                            }
-
-                            if((prevIndex + 1) % maxPacketCount != index && recv->data[0] == 0) {
-                                int diff = min(abs(index - prevIndex), maxPacketCount - abs(index - prevIndex));
-                                int smaller, bigger;
-                                if(compareSeqNum(prevIndex, index) < 0) {
-                                    smaller = prevIndex;
-                                    bigger = index;
-                                } else {
-                                    smaller = index;
-                                    bigger = prevIndex;
-                                }
-                                cout << "Packets Dropped: " << (diff - 1) << endl << "Index: " << smaller << "\nPrev: " << bigger << endl << endl;
-                                if (diff < 5) {
-                                    for (int i = smaller + 1; i < bigger; i = (i + 1) % (maxPacketCount)) {
-                                        unorderedPack.push_back(i);
-                                    }
-                                } else {
-                                    for (int i = smaller + 1; i < bigger; i++) {
-                                        if(!buf[i].transmitRequested) {
-                                            stringstream send;
-                                            send << '7';
-                                            send << (char)(i / maxByteVal);
-                                            send << (char)(i % maxByteVal);
-                                            buf[i].transmitRequested = true;
-                                            unreliableSendPacket(send.str(), false);
-                                            retransmitRequest req;
-                                            req.start = chrono::steady_clock::now();
-                                            req.isFrame = true;
-                                            req.data = send.str();
-                                            retransMutex.lock();
-                                            retransmits.emplace(i, req);
-                                            retransMutex.unlock();
-                                        }
-                                    }
-                                    /* send << '8' << (char)(((prevIndex + 1) % maxPacketCount) / maxByteVal) << (char)(((prevIndex + 1) % maxPacketCount) % maxByteVal) << (char)(recv->data[1]) << (char)(recv->data[2]); */
-                                }
-                            }
-
-                            if(recv->data[0] == 0) {
-                                buf[index].type = FRAME;
-                                prevIndex = index;
-                            } else if (recv->data[0] == 1){
-                                buf[index].type = FRAME;
-                            } else if((uint8_t) recv->data[0] == 3) {
-                                buf[index].type = INPUTRETRANSMIT;
-                                int sHigh, sLow, eHigh, eLow;
-                                sHigh = (uint8_t)buf[index].data[0];
-                                sLow = (uint8_t)buf[index].data[1];
-                                eHigh = (uint8_t)buf[index].data[2];
-                                eLow = (uint8_t)buf[index].data[3];
-                                if (sHigh < 60 && eHigh < 60) {
-                                    int beginning = sHigh * maxByteVal + sLow;
-                                    int end = eHigh * maxByteVal + eLow;
-                                    int smaller, bigger;
-                                    if (compareSeqNum(beginning, end) < 0) {
-                                        smaller = beginning;
-                                        bigger = end;
-                                    } else {
-                                        smaller = end;
-                                        bigger = beginning;
-                                    }
-                                    cout << "Retransmit " << beginning << " " << end << endl;
-                                    for (int i = beginning; i < end; i = (i + 1) % maxPacketCount) {
-                                        stringstream send;
-                                        send << (char)(i / maxByteVal) << (char)(i % maxByteVal);
-                                        for(int j = 0; j < backupLens[i]; j++) {
-                                            send << (char)(backupBuf[i*30 + j]);
-                                        }
-                                        for(int j = 0; j < send.str().length(); j++) {
-                                            cout << (int)send.str()[j] << " ";
-                                        }
-                                        cout << "with length " << backupLens[i] << endl;
-
-                                        unreliableSendPacket(send.str(), true);
-
-                                        retransmitRequest req;
-                                        req.start = chrono::steady_clock::now();
-                                        req.isFrame = false;
-                                        retransMutex.lock();
-                                        retransmits.emplace(i, req);
-                                        retransMutex.unlock();
-                                    }
-                                }
-                            } else if ((uint8_t) recv->data[0] == 5) {
-                                for(int i = 1; i < recv->len; i+=2) {
-                                    if (i+1 < recv->len) {
-                                        index = (int) ((recv->data[i]) * maxByteVal + (recv->data[i+1]));
-                                        cout << "Retransmit " << index << endl;
-                                        if(index < maxPacketCount) {
-                                            stringstream send;
-                                            send << (char)(index / maxByteVal);
-                                            send << (char)(index % maxByteVal);
-                                            for(int j = 0; j < backupLens[index]; j++) {
-                                                send << (char)(backupBuf[index*30 + j]);
-                                            }
-
-                                            for(int j = 0; j < send.str().length(); j++) {
-                                                cout << (int)send.str()[j] << " ";
-                                            }
-                                            cout << endl;
-
-                                            unreliableSendPacket(send.str(), true);
-                                            retransmitRequest req;
-                                            req.start = chrono::steady_clock::now();
-
-                                            retransMutex.lock();
-                                            req.isFrame = false;
-                                            retransmits.emplace(index, req);
-                                            retransMutex.unlock();
-                                        }
-                                    }
-                                }
-                                break;
-                            }
-
-
-                        while(buf[packetPos].visited != -1) {
-                            switch(buf[packetPos].type) {
-                                case FRAME: {
-                                    data_size = buf[packetPos].visited;
-                                    Uint8* bufPtr = buf[packetPos].data;
-                                    while(data_size > 0) {
-                                        ret = av_parser_parse2(parser, c, &pkt->data, &pkt->size,
-                                                bufPtr, data_size, AV_NOPTS_VALUE, AV_NOPTS_VALUE, 0);
-                                        if (ret < 0) {
-                                            fprintf(stderr, "Error while parsing\n");
-                                            exit(1);
-                                        }
-                                        bufPtr      += ret;
-                                        data_size -= ret;
-
-                                        if (pkt->size) {
-                                            decode(c, frame, pkt);
-                                        }
-                                    }
-                                    //printf("Received (%i): \n", len);
-                                    break;
-                                }
-                            }
-                            buf[packetPos].visited = -1;
-                            cout << "packetPos visit " << packetPos << endl;
-                            packetPos++;
-                            if(packetPos >= maxPacketCount) {
-                                packetPos = 0;
-                            }
-                        }
+                uint64_t wallNow = capture.isOpen() ? captureNow() : 0;
+                for(int i = 0; i < count; i++) {
+                    if(capture.isOpen()) {
+                        // back dated to the arrival so replays see the network's timing too
+                        int64_t waited = chrono::duration_cast<chrono::nanoseconds>(now - batch[i].arrival).count();
+                        capture.write(wallNow - max<int64_t>(waited, 0), batch[i].data, batch[i].len);
                     }
-                } 
+                    receiver.receive(batch[i].data, batch[i].len, batch[i].arrival);
+                }
+                receiver.socketDrops(sock.drops);
             }
-        } else {
-                SDLNet_UDP_Close(sock);
-                SDLNet_UDP_DelSocket(socket_set, sock);
-                sock = NULL;
+            if(count > 0) {
+                firstReceive = false;
+                lastDatagram = now;
+            } else if(now - lastDatagram >= (firstReceive ? firstDatagramTimeout : streamTimeout)) {
+                sendQueue.close();
+                sock.close();
                 haveClient = false;
                 firstReceive = true;
-                packetPos = 0;
-                for(int i = 0; i < maxPacketCount; i++) {
-                    buf[i].visited = -1;
+                if(opts.headless) {
+                    LOG_INFO("stream stopped");
+                    logSummary();
+                    done = true;
                 }
-                prevIndex = -1;
-                index = 0;
-                hpCount = 0;
-                lpCount = 0;
-                unorderedPack.clear();
+                inputChannel.reset();
+                motion.dirty = false;
+                if(receiver.latency.count() > 0) {
+                    receiver.latency.exportTo(latencyFile);
+                }
+                perfPackets += receiver.stats.packets;
+                perfFrames += receiver.stats.frames;
+                receiver.reset();
+                capture.close();
             }
         }
     }
 
-    ImGui_ImplSDLRenderer2_Shutdown();
-    ImGui_ImplSDL2_Shutdown();
-    ImGui::DestroyContext();
-    SDLNet_UDP_Close(sock);
+    if(opts.headless) {
+        if(haveClient) {
+            logSummary();
+        }
+        if(frameSink) {
+            fclose(frameSink);
+        }
+    } else {
+        ImGui_ImplSDLRenderer2_Shutdown();
+        ImGui_ImplSDL2_Shutdown();
+        ImGui::DestroyContext();
+    }
+    logPerf();
+    if(receiver.latency.count() > 0) {
+        receiver.latency.exportTo(latencyFile);
+    }
+    sendQueue.close();
+    capture.close();
+    sock.close();
 
     clean();
-    SDLNet_Quit();
     SDL_Quit();
 
     run = false;
     alive.join();
     retransmit.join();
+    logStop();
+    return exitCode;
 }
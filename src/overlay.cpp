@@ -0,0 +1,72 @@
+#include <cfloat>
+
+#include <imgui_impl_sdl2.h>
+#include <imgui_impl_sdlrenderer2.h>
+
+#include <overlay.h>
+
+using namespace std;
+
+static void plot(const char* label, const statsSeries& series, const char* format) {
+    char overlay[32];
+    snprintf(overlay, sizeof(overlay), format, series.last);
+    ImGui::PlotLines(label, series.values, statsHistory, series.offset, overlay, 0, FLT_MAX, ImVec2(260, 32));
+}
+
+static void drawStatsWindow(const SessionStats& stats) {
+    ImGui::SetNextWindowPos(ImVec2(10, 10));
+    ImGui::SetNextWindowBgAlpha(0.6f);
+    ImGui::Begin("Stats", 0, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize |
+            ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav | ImGuiWindowFlags_NoMove);
+
+    ImGui::Text("%llu packets  %llu lost  %llu recovered  %llu NACKs",
+            (unsigned long long)stats.packets, (unsigned long long)stats.lost,
+            (unsigned long long)stats.recovered, (unsigned long long)stats.nacks);
+    ImGui::Text("%llu NACKs suppressed  %llu skipped  %llu keyframes requested  %llu unsent",
+            (unsigned long long)stats.nacksSuppressed, (unsigned long long)stats.skipped,
+            (unsigned long long)stats.keyframeRequests, (unsigned long long)stats.sendDrops);
+    plot("bitrate", stats.bitrateMbps, "%.1f Mbps");
+    plot("estimate", stats.estimateMbps, "%.1f Mbps");
+    plot("packets", stats.packetRate, "%.0f /s");
+    plot("loss", stats.lossRate, "%.1f /s");
+    plot("kernel drops", stats.kernelDropRate, "%.1f /s");
+    plot("recovered", stats.recoveryRate, "%.1f /s");
+    plot("NACKs", stats.nacksOutstanding, "%.0f outstanding");
+    plot("RTT", stats.rttMs, "%.1f ms");
+    plot("jitter", stats.jitter, "%.2f ms");
+    plot("decode", stats.decodeMs, "%.2f ms");
+    plot("present", stats.presentMs, "%.2f ms");
+    plot("fps", stats.fps, "%.1f");
+
+    ImGui::End();
+}
+
+static void drawLatencyWindow(LatencyProbe& latency, const string& latencyFile) {
+    ImGui::Begin("Input latency", 0, ImGuiWindowFlags_AlwaysAutoResize);
+
+    ImGui::Text("%zu samples  p50 %.1f ms  p95 %.1f ms  p99 %.1f ms", latency.count(),
+            latency.percentile(0.5f), latency.percentile(0.95f), latency.percentile(0.99f));
+    ImGui::PlotHistogram("##latency", latency.histogram(), latencyBuckets, 0,
+            "0 - 500 ms", 0, FLT_MAX, ImVec2(400, 80));
+    if (ImGui::Button("Export")) {
+        latency.exportTo(latencyFile);
+    }
+
+    ImGui::End();
+}
+
+void drawSessionUi(const SessionStats& stats, LatencyProbe& latency, const string& latencyFile, bool showStats) {
+    ImGui_ImplSDLRenderer2_NewFrame();
+    ImGui_ImplSDL2_NewFrame();
+    ImGui::NewFrame();
+
+    if(showStats) {
+        drawStatsWindow(stats);
+    }
+    if(latency.enabled) {
+        drawLatencyWindow(latency, latencyFile);
+    }
+
+    ImGui::Render();
+    ImGui_ImplSDLRenderer2_RenderDrawData(ImGui::GetDrawData());
+}
@@ -0,0 +1,153 @@
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <sstream>
+
+#include <log.h>
+#include <perf.h>
+
+using namespace std;
+
+static const char* eventNames[perfEventCount] = { "cycles", "instructions", "L1d misses", "LLC misses", "branch misses" };
+static const char* stageNames[perfStageCount] = { "receive", "decrypt", "parse", "decode" };
+
+// counters of the thread that called perfStart, read as one group
+static int groupFd = -1;
+static int fds[perfEventCount];
+// position of each event in a group read, -1 if it could not be opened
+static int slots[perfEventCount];
+static int opened = 0;
+static thread_local bool perfThread = false;
+
+static perfCounts totals[perfStageCount];
+static uint64_t calls[perfStageCount];
+
+static int openEvent(uint32_t type, uint64_t config, int group) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.disabled = group == -1;
+    // user space only, which works at the default perf_event_paranoid level
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+bool perfStart() {
+    perfStop();
+    struct { uint32_t type; uint64_t config; } events[perfEventCount] = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16 },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    };
+    for(int i = 0; i < perfEventCount; i++) {
+        fds[i] = openEvent(events[i].type, events[i].config, groupFd);
+        slots[i] = -1;
+        if(fds[i] < 0) {
+            LOG_WARN("perf counter {} unavailable: {}", eventNames[i], strerror(errno));
+            continue;
+        }
+        if(groupFd == -1) {
+            groupFd = fds[i];
+        }
+        slots[i] = opened++;
+    }
+    if(groupFd == -1) {
+        return false;
+    }
+    perfReset();
+    ioctl(groupFd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(groupFd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    perfThread = true;
+    return true;
+}
+
+void perfStop() {
+    for(int i = 0; i < perfEventCount && groupFd != -1; i++) {
+        if(slots[i] != -1) {
+            close(fds[i]);
+        }
+    }
+    groupFd = -1;
+    opened = 0;
+    perfThread = false;
+}
+
+bool perfActive() {
+    return perfThread;
+}
+
+perfCounts perfRead() {
+    perfCounts counts;
+    uint64_t buf[1 + perfEventCount];
+    if(groupFd == -1 || read(groupFd, buf, sizeof(buf)) < (ssize_t)(sizeof(uint64_t) * (1 + opened))) {
+        return counts;
+    }
+    for(int i = 0; i < perfEventCount; i++) {
+        if(slots[i] != -1) {
+            counts.values[i] = buf[1 + slots[i]];
+        }
+    }
+    return counts;
+}
+
+void perfAdd(perfStage stage, const perfCounts& begin, const perfCounts& end) {
+    for(int i = 0; i < perfEventCount; i++) {
+        totals[stage].values[i] += end.values[i] - begin.values[i];
+    }
+    calls[stage]++;
+}
+
+void perfReset() {
+    for(int i = 0; i < perfStageCount; i++) {
+        totals[i] = perfCounts();
+        calls[i] = 0;
+    }
+}
+
+string perfFormat(const perfCounts& begin, const perfCounts& end, double ops) {
+    stringstream out;
+    out.precision(4);
+    for(int i = 0; i < perfEventCount; i++) {
+        if(slots[i] != -1) {
+            out << eventNames[i] << ' ' << (end.values[i] - begin.values[i]) / ops << ' ';
+        }
+    }
+    double cycles = end.values[PERF_CYCLES] - begin.values[PERF_CYCLES];
+    if(cycles > 0) {
+        out << "IPC " << (end.values[PERF_INSTRUCTIONS] - begin.values[PERF_INSTRUCTIONS]) / cycles;
+    }
+    return out.str();
+}
+
+void perfReport(uint64_t packets, uint64_t frames) {
+    for(int i = 0; i < perfStageCount; i++) {
+        if(calls[i] == 0) {
+            continue;
+        }
+        const uint64_t* v = totals[i].values;
+        double ipc = v[PERF_CYCLES] ? (double)v[PERF_INSTRUCTIONS] / v[PERF_CYCLES] : 0;
+        if(packets > 0) {
+            double n = packets;
+            LOG_INFO("{} per packet: {} cycles {} instructions {} IPC", stageNames[i], v[PERF_CYCLES] / n,
+                    v[PERF_INSTRUCTIONS] / n, ipc);
+            LOG_INFO("{} per packet: {} L1d {} LLC {} branch misses", stageNames[i], v[PERF_L1D_MISSES] / n,
+                    v[PERF_LLC_MISSES] / n, v[PERF_BRANCH_MISSES] / n);
+        }
+        if(frames > 0) {
+            double n = frames;
+            LOG_INFO("{} per frame: {} cycles {} instructions {} IPC", stageNames[i], v[PERF_CYCLES] / n,
+                    v[PERF_INSTRUCTIONS] / n, ipc);
+            LOG_INFO("{} per frame: {} L1d {} LLC {} branch misses", stageNames[i], v[PERF_L1D_MISSES] / n,
+                    v[PERF_LLC_MISSES] / n, v[PERF_BRANCH_MISSES] / n);
+        }
+    }
+}
@@ -0,0 +1,771 @@
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+#include <log.h>
+#include <perf.h>
+#include <receiver.h>
+#include <trace.h>
+
+using namespace std;
+
+Receiver::Receiver() : buf(new recvPacket[maxPacketCount]) {
+    en = EVP_CIPHER_CTX_new();
+    de = EVP_CIPHER_CTX_new();
+}
+
+Receiver::~Receiver() {
+    av_parser_close(parser);
+    av_packet_free(&pkt);
+    av_frame_free(&frame);
+    avcodec_free_context(&c);
+    EVP_CIPHER_CTX_free(en);
+    EVP_CIPHER_CTX_free(de);
+}
+
+bool Receiver::init() {
+    string key_data = aesKeyData;
+
+    /* gen key and iv. init the cipher ctx object */
+    if (aes_init(key_data, key_data.length(), (unsigned char*)aesSalt, en, de)) {
+        LOG_ERROR("Couldn't initialize AES cipher");
+        return false;
+    }
+
+    // ffmpeg setup
+
+    pkt = av_packet_alloc();
+    if (!pkt) {
+        LOG_ERROR("error allocating packet");
+        return false;
+    }
+
+    codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+    if(!codec) {
+        LOG_ERROR("error finding codec");
+        return false;
+    }
+
+    parser = av_parser_init(codec->id);
+    if (!parser) {
+        LOG_ERROR("Error finding parser");
+        return false;
+    }
+
+    c = avcodec_alloc_context3(codec);
+    if (!c) {
+        LOG_ERROR("Could not allocate video context memory");
+        return false;
+    }
+
+    if (avcodec_open2(c, codec, NULL) < 0) {
+        LOG_ERROR("Could not open codec");
+        return false;
+    }
+
+    frame = av_frame_alloc();
+    if (!frame) {
+        LOG_ERROR("could not allocate video frame");
+        return false;
+    }
+    return true;
+}
+
+void Receiver::decode() {
+    int ret;
+
+    auto start = clock::now();
+    uint32_t traceId = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : 0;
+    {
+        TRACE_SPAN("send_packet", traceId);
+        PERF_SCOPE(STAGE_DECODE);
+        ret = avcodec_send_packet(c, pkt);
+    }
+    // expected after a lost packet was skipped, the decoder conceals until the next keyframe
+    if (ret == AVERROR_INVALIDDATA) {
+        LOG_WARN("corrupt access unit at {}", traceId);
+        return;
+    }
+    if (ret < 0) {
+        exit(1);
+    }
+
+    while (ret >= 0) {
+        {
+            TRACE_SPAN("receive_frame", traceId);
+            PERF_SCOPE(STAGE_DECODE);
+            ret = avcodec_receive_frame(c, frame);
+        }
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF || ret == AVERROR_INVALIDDATA)
+            return;
+        else if (ret < 0) {
+            exit(1);
+        }
+
+        stats.decoded(chrono::duration_cast<chrono::microseconds>(clock::now() - start));
+        if(present) {
+            present(frame);
+        }
+        start = clock::now();
+    }
+}
+
+// what the NAL units starting in a packet tell about the pictures around it
+struct nalScan {
+    // header byte of the first NAL unit starting here, 0 if there is none
+    uint8_t first = 0;
+    // header byte of the last slice or parameter set NAL unit starting here, 0 if there is none
+    uint8_t last = 0;
+    // an access unit delimiter, SPS or first slice of a picture starts here
+    bool frameStart = false;
+    // the first NAL unit starting here is a non-IDR slice other than the first of its picture
+    bool continuesP = false;
+};
+
+static nalScan scanNals(const uint8_t* data, int len) {
+    nalScan scan;
+    const uint8_t* end = data + len - 1;
+    for(const uint8_t* p = data + 2; p < end; p++) {
+        p = (const uint8_t*)memchr(p, 1, end - p);
+        if(!p) {
+            break;
+        }
+        if(p[-1] != 0 || p[-2] != 0) {
+            continue;
+        }
+        int type = p[1] & 0x1f;
+        // first_mb_in_slice leads the slice header, exp-Golomb 0 is a single set bit
+        bool haveFirstMb = p + 2 < data + len;
+        bool firstSlice = (type == 1 || type == 5) && haveFirstMb && (p[2] & 0x80);
+        if(!scan.first) {
+            scan.first = p[1];
+            scan.continuesP = type == 1 && haveFirstMb && !(p[2] & 0x80);
+        }
+        if(type == 9 || type == 7 || firstSlice) {
+            scan.frameStart = true;
+        }
+        if(type == 1 || type == 5 || type == 7 || type == 8) {
+            scan.last = p[1];
+        }
+    }
+    return scan;
+}
+
+// how far past a gap insidePicture looks for the next NAL unit start
+constexpr int classifyWindow = 64;
+
+static bool keyframeNal(uint8_t header) {
+    int type = header & 0x1f;
+    return type == 5 || type == 7 || type == 8;
+}
+
+// callers hold retransMutex
+bool Receiver::hopeless(const retransmitRequest& req, clock::time_point now) {
+    return !req.keyframe && playoutDelay.count() > 0 && now + rtt.srtt > req.deadline;
+}
+
+// true when seq's nal and frameStart describe it: it arrived, was decoded or its NACK classified it
+bool Receiver::settled(int seq) {
+    return buf[seq].visited != -1 || buf[seq].transmitRequested || compareSeqNum(seq, packetPos) < 0;
+}
+
+// A missing packet holds nothing but P slices if the packet before it ends in a P slice and
+// the first NAL unit that starts after it continues a P picture. Anything else may hide an
+// IDR picture or parameter sets, including not having seen that NAL unit yet.
+// It is then taken to belong to the picture of the packet before.
+bool Receiver::insidePicture(int seq) {
+    const recvPacket& before = buf[(seq + maxPacketCount - 1) % maxPacketCount];
+    if(!settled((seq + maxPacketCount - 1) % maxPacketCount) || !before.nal || keyframeNal(before.nal) ||
+            before.frameStart == clock::time_point()) {
+        return false;
+    }
+    for(int i = 1; i <= classifyWindow; i++) {
+        const recvPacket& next = buf[(seq + i) % maxPacketCount];
+        if(next.visited > 0 && next.firstNal) {
+            return next.continuesP;
+        }
+    }
+    return false;
+}
+
+// sets the NAL, picture and deadline of missing packet seq from what arrived around it so far
+void Receiver::classify(int seq, retransmitRequest& req) {
+    int before = (seq + maxPacketCount - 1) % maxPacketCount;
+    bool inside = insidePicture(seq);
+    buf[seq].nal = inside ? buf[before].nal : 0;
+    buf[seq].frameStart = inside ? buf[before].frameStart : req.sent;
+    req.deadline = buf[seq].frameStart + playoutDelay;
+    req.keyframe = !inside;
+    req.reclassify = false;
+}
+
+// callers hold retransMutex
+void Receiver::reclassifyLater(int seq) {
+    if(!buf[seq].transmitRequested) {
+        return;
+    }
+    auto request = retransmits.find(seq);
+    if(request != retransmits.end() && request->second.keyframe) {
+        request->second.reclassify = true;
+    }
+}
+
+// flags the keyframe gaps seq's arrival may tell more about: the one right after it, and
+// those before it that no other NAL unit start lies between
+void Receiver::neighbourArrived(int seq) {
+    // most packets neither follow a NACKed one nor start a NAL unit
+    if(!buf[(seq + 1) % maxPacketCount].transmitRequested && !buf[seq].firstNal) {
+        return;
+    }
+    lock_guard<mutex> guard(retransMutex);
+    if(retransmits.empty()) {
+        return;
+    }
+    reclassifyLater((seq + 1) % maxPacketCount);
+    if(!buf[seq].firstNal) {
+        return;
+    }
+    for(int i = 1; i <= classifyWindow; i++) {
+        int slot = (seq + maxPacketCount - i) % maxPacketCount;
+        if(compareSeqNum(slot, packetPos) < 0 || (buf[slot].visited > 0 && buf[slot].firstNal)) {
+            break;
+        }
+        reclassifyLater(slot);
+    }
+}
+
+string encodeNack(int seq) {
+    stringstream send;
+    send << '7';
+    send << (char)(seq / maxByteVal);
+    send << (char)(seq % maxByteVal);
+    return send.str();
+}
+
+// callers hold no lock
+void Receiver::nack(int seq) {
+    if(buf[seq].transmitRequested) {
+        return;
+    }
+    retransmitRequest req;
+    req.sent = timeSource();
+    // gaps are NACKed oldest first, so the packet before is classified already
+    classify(seq, req);
+    buf[seq].transmitRequested = true;
+    req.data = encodeNack(seq);
+    retransMutex.lock();
+    req.due = req.sent + rtt.rto(initialRto);
+    bool late = hopeless(req, req.sent);
+    retransmits.emplace(seq, req);
+    retransMutex.unlock();
+    if(late) {
+        suppressed++;
+        LOG_DEBUG("NACK suppressed: {}", seq);
+        return;
+    }
+    if(sendControl) {
+        sendControl(req.data);
+    }
+    stats.nackSent();
+}
+
+// gives up on a lost packet whose deadline passed by leaving an empty packet in its slot,
+// returns false if it is still worth waiting for
+bool Receiver::giveUp(int seq) {
+    if(!buf[seq].transmitRequested || (playoutDelay.count() == 0 && keyframeWait.count() == 0)) {
+        return false;
+    }
+    lock_guard<mutex> guard(retransMutex);
+    auto request = retransmits.find(seq);
+    if(request == retransmits.end()) {
+        return false;
+    }
+    // the rest of the picture may have arrived since the NACK and tell what the packet held
+    if(request->second.keyframe && request->second.reclassify) {
+        classify(seq, request->second);
+    }
+    const retransmitRequest& req = request->second;
+    auto now = timeSource();
+    bool keyframe = req.keyframe;
+    if(keyframe ? keyframeWait.count() == 0 || now - req.sent < keyframeWait :
+            playoutDelay.count() == 0 || req.deadline > now) {
+        return false;
+    }
+    retransmits.erase(request);
+    buf[seq].transmitRequested = false;
+    buf[seq].visited = 0;
+    buf[seq].type = FRAME;
+    // the gap after this one is next and goes by what this one was taken to hold
+    reclassifyLater((seq + 1) % maxPacketCount);
+    stats.packetSkipped();
+    LOG_DEBUG("Gave up on {}", seq);
+    if(keyframe) {
+        requestKeyframe(now);
+    }
+    return true;
+}
+
+// 'k', at most once per keyframeWait since a lost keyframe is a burst of gaps given up together
+void Receiver::requestKeyframe(clock::time_point now) {
+    if(lastKeyframeRequest != clock::time_point() && now - lastKeyframeRequest < keyframeWait) {
+        return;
+    }
+    lastKeyframeRequest = now;
+    stats.keyframeRequested();
+    LOG_WARN("keyframe data lost, asking for a new keyframe");
+    if(requestKeyframes && sendControl) {
+        sendControl("k");
+    }
+}
+
+// callers hold retransMutex
+void Receiver::ack(int seq, clock::time_point arrival) {
+    if(!batchAcks) {
+        char msg[3] = { '9', (char)(seq / maxByteVal), (char)(seq % maxByteVal) };
+        LOG_DEBUG("ack sent: {}", seq);
+        if(sendControl) {
+            sendControl(string(msg, sizeof(msg)));
+        }
+        return;
+    }
+    if(pendingAcks.empty()) {
+        ackDue = arrival + ackDelay;
+    }
+    pendingAcks.push_back(seq);
+    if((int)pendingAcks.size() >= ackBatch) {
+        flushAcks();
+    }
+}
+
+// 'a' followed by a base sequence number and a 32 bit bitmap, big endian, bit i acks
+// base + 1 + i. seqs go out in as few of these as they fit in.
+void encodeAcks(vector<int>& seqs, const function<void(const string&)>& send) {
+    int first = seqs.front();
+    sort(seqs.begin(), seqs.end(), [first](int a, int b) {
+        return (a - first + maxPacketCount) % maxPacketCount < (b - first + maxPacketCount) % maxPacketCount;
+    });
+    for(size_t i = 0; i < seqs.size();) {
+        int base = seqs[i++];
+        uint32_t bitmap = 0;
+        while(i < seqs.size()) {
+            int offset = (seqs[i] - base + maxPacketCount) % maxPacketCount;
+            if(offset > 32) {
+                break;
+            }
+            if(offset > 0) {
+                bitmap |= 1u << (offset - 1);
+            }
+            i++;
+        }
+        char msg[7] = { 'a', (char)(base / maxByteVal), (char)(base % maxByteVal),
+            (char)(bitmap >> 24), (char)(bitmap >> 16), (char)(bitmap >> 8), (char)bitmap };
+        LOG_DEBUG("ack sent: {} {}", base, bitmap);
+        send(string(msg, sizeof(msg)));
+    }
+}
+
+// callers hold retransMutex
+void Receiver::flushAcks() {
+    encodeAcks(pendingAcks, [this](const string& msg) {
+        if(sendControl) {
+            sendControl(msg);
+        }
+    });
+    pendingAcks.clear();
+}
+
+// feeds every packet that is next in sequence to the parser and decoder
+void Receiver::drain() {
+    while(buf[packetPos].visited != -1 || giveUp(packetPos)) {
+        switch(buf[packetPos].type) {
+            case FRAME: {
+                size_t data_size = buf[packetPos].visited;
+                uint8_t* bufPtr = buf[packetPos].data;
+                while(data_size > 0) {
+                    int ret;
+                    // the sequence number rides along as pts so presented frames can be matched to stamps
+                    {
+                        TRACE_SPAN("parse", packetPos);
+                        PERF_SCOPE(STAGE_PARSE);
+                        ret = av_parser_parse2(parser, c, &pkt->data, &pkt->size,
+                                bufPtr, data_size, packetPos, AV_NOPTS_VALUE, 0);
+                    }
+                    if (ret < 0) {
+                        fprintf(stderr, "Error while parsing\n");
+                        exit(1);
+                    }
+                    bufPtr      += ret;
+                    data_size -= ret;
+
+                    if (pkt->size) {
+                        // the parser reports the pts of the input the packet started in, it is not set on pkt
+                        pkt->pts = parser->pts;
+                        pkt->dts = parser->dts;
+                        decode();
+                    }
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        buf[packetPos].visited = -1;
+        LOG_DEBUG("packetPos visit {}", packetPos);
+        packetPos++;
+        if(packetPos >= maxPacketCount) {
+            packetPos = 0;
+        }
+    }
+}
+
+// 'b' followed by the estimate in kbit/s, 32 bits big endian
+void Receiver::sendEstimate() {
+    uint32_t kbps = bandwidth.estimate() / 1000;
+    string msg = "b";
+    msg += (char)(kbps >> 24);
+    msg += (char)(kbps >> 16);
+    msg += (char)(kbps >> 8);
+    msg += (char)kbps;
+    LOG_DEBUG("bandwidth estimate {} kbit/s", kbps);
+    if(sendControl) {
+        sendControl(msg);
+    }
+}
+
+void Receiver::trackSequence(int seq) {
+    if(!haveSeq) {
+        haveSeq = true;
+        highestSeq = seq;
+        extendedHighest = baseSeq = seq;
+    } else if(compareSeqNum(seq, highestSeq) > 0) {
+        extendedHighest += (seq - highestSeq + maxPacketCount) % maxPacketCount;
+        highestSeq = seq;
+    }
+    seqReceived++;
+}
+
+// 'r' followed by, big endian:
+//   fraction lost since the last report (8 bits, /256), cumulative lost (24 bits),
+//   extended highest sequence number (32 bits), interarrival jitter in microseconds (32 bits),
+//   frames decoded and presented since the last report (16 bits each),
+//   mean decode and present time over them in units of 100 microseconds (16 bits each),
+//   datagrams dropped by the client's own socket since the last report (16 bits)
+// Retransmissions count as received, so loss is what is still missing. Socket drops are
+// part of the loss, the sender can subtract them to see what the network lost.
+void Receiver::sendReport(clock::time_point now) {
+    lastReport = now;
+    uint64_t expected = (uint64_t)extendedHighest - baseSeq + 1;
+    uint64_t expectedInterval = expected - lastExpected;
+    uint64_t receivedInterval = seqReceived - lastSeqReceived;
+    lastExpected = expected;
+    lastSeqReceived = seqReceived;
+    int64_t lostInterval = (int64_t)expectedInterval - (int64_t)receivedInterval;
+    uint8_t fraction = expectedInterval == 0 || lostInterval <= 0 ? 0 : (lostInterval << 8) / expectedInterval;
+    int64_t lost = (int64_t)expected - (int64_t)seqReceived;
+    uint32_t cumulative = min<int64_t>(max<int64_t>(lost, 0), 0xFFFFFF);
+
+    uint64_t decoded = stats.decodedFrames - lastDecoded;
+    uint64_t presented = stats.frames - lastPresented;
+    uint32_t decodeUnits = decoded ? (stats.decodeUs - lastDecodeUs) / decoded / 100 : 0;
+    uint32_t presentUnits = presented ? (stats.presentUs - lastPresentUs) / presented / 100 : 0;
+    lastDecoded = stats.decodedFrames;
+    lastDecodeUs = stats.decodeUs;
+    lastPresented = stats.frames;
+    lastPresentUs = stats.presentUs;
+    uint32_t jitterUs = stats.jitterMs * 1000;
+
+    uint8_t report[23];
+    report[0] = 'r';
+    report[1] = fraction;
+    report[2] = cumulative >> 16;
+    report[3] = cumulative >> 8;
+    report[4] = cumulative;
+    for(int i = 0; i < 4; i++) {
+        report[5 + i] = extendedHighest >> (24 - 8 * i);
+        report[9 + i] = jitterUs >> (24 - 8 * i);
+    }
+    uint16_t health[4] = { (uint16_t)min<uint64_t>(decoded, 0xFFFF), (uint16_t)min<uint64_t>(presented, 0xFFFF),
+        (uint16_t)min<uint32_t>(decodeUnits, 0xFFFF), (uint16_t)min<uint32_t>(presentUnits, 0xFFFF) };
+    for(int i = 0; i < 4; i++) {
+        report[13 + 2 * i] = health[i] >> 8;
+        report[14 + 2 * i] = health[i];
+    }
+    uint16_t socketDropped = min<uint32_t>(reportSocketDrops, 0xFFFF);
+    report[21] = socketDropped >> 8;
+    report[22] = socketDropped;
+    reportSocketDrops = 0;
+    if(sendControl) {
+        sendControl(string((char*)report, sizeof(report)));
+    }
+}
+
+bool parseHeader(const uint8_t* data, int len, datagramHeader& header) {
+    if(len < 3) {
+        return false;
+    }
+    header.type = data[0];
+    header.seq = data[1] * maxByteVal + data[2];
+    return true;
+}
+
+void Receiver::receive(const uint8_t* recvData, int recvLen, clock::time_point arrival) {
+    datagramHeader header;
+    if(!parseHeader(recvData, recvLen, header)) {
+        return;
+    }
+    PERF_SCOPE(STAGE_RECEIVE);
+    stats.packetReceived(recvLen, arrival);
+    stats.nacksSuppressed = suppressed.load(memory_order_relaxed);
+
+    if(header.type == 2) {
+
+    } else if (header.type == INPUTACK || header.type == INPUTSACK) {
+        if(inputControl) {
+            inputControl(recvData, recvLen);
+        }
+    } else if (header.type == FRAMESTAMP) {
+        if(recvLen >= 7) {
+            int seq = header.seq;
+            uint32_t stamp = (uint32_t)recvData[3] << 24 | (uint32_t)recvData[4] << 16 |
+                (uint32_t)recvData[5] << 8 | recvData[6];
+            latency.frameStamp(seq, stamp);
+        }
+    } else {
+        const uint8_t *data = &recvData[3];
+        size_t   data_size = recvLen - 3;
+
+        index = header.seq;
+        if(index >= maxPacketCount) {
+            return;
+        }
+        trackSequence(index);
+        if(sendReports && arrival - lastReport >= reportInterval) {
+            sendReport(arrival);
+        }
+        if(header.type == 0) {
+            // retransmissions are paced by NACKs, not by the link, so only first transmissions count
+            bandwidth.packetReceived(arrival, recvLen);
+            stats.estimateBps = bandwidth.estimate();
+            if(sendEstimates && bandwidth.feedbackDue(arrival)) {
+                sendEstimate();
+            }
+        }
+        // the retransmit thread may be asleep for a whole RTO, so arrivals flush late acks too
+        if(ackDue != clock::time_point() && arrival >= ackDue) {
+            lock_guard<mutex> guard(retransMutex);
+            if(!pendingAcks.empty()) {
+                flushAcks();
+            }
+            ackDue = clock::time_point();
+        }
+        LOG_DEBUG("{}", index);
+        if(header.type == 1) {
+            stats.packetRecovered();
+            retransMutex.lock();
+            buf[index].transmitRequested = false;
+            auto request = retransmits.find(index);
+            if(request != retransmits.end()) {
+                // a repeated NACK cannot tell which one was answered, so only single NACKs are timed
+                if(request->second.attempts == 0) {
+                    rtt.sample(chrono::duration_cast<chrono::microseconds>(arrival - request->second.sent));
+                }
+                retransmits.erase(request);
+            }
+            ack(index, arrival);
+            retransMutex.unlock();
+        }
+        if(compareSeqNum(index, packetPos) >= 0) {
+
+            int len = data_size;
+            unsigned char* plaintext;
+            {
+                TRACE_SPAN("decrypt", index);
+                PERF_SCOPE(STAGE_DECRYPT);
+                plaintext = aes_decrypt(de, (unsigned char*)data, &len);
+            }
+            uint64_t reorderStart = traceEnabled ? traceNow() : 0;
+
+            if(len < 0 || len > (int)sizeof(buf[index].data)) {
+                delete[] plaintext;
+                return;
+            }
+            memcpy(&buf[index].data, plaintext, len);
+            delete[] plaintext;
+            buf[index].visited = len;
+            nalScan scan = scanNals(buf[index].data, len);
+            int before = (index + maxPacketCount - 1) % maxPacketCount;
+            // the packet after a gap inherits nothing from it, its picture is taken to start here
+            bool inherit = settled(before) && buf[before].frameStart != clock::time_point();
+            buf[index].nal = scan.last ? scan.last : (inherit ? buf[before].nal : 0);
+            buf[index].frameStart = scan.frameStart || !inherit ? arrival : buf[before].frameStart;
+            buf[index].firstNal = scan.first;
+            buf[index].continuesP = scan.continuesP;
+            neighbourArrived(index);
+
+            auto match = find(unorderedPack.begin(), unorderedPack.end(), index);
+            if (match != unorderedPack.end()) {
+                unorderedPack.erase(match);
+            } else {
+                if (unorderedPack.size() > 0) {
+                    auto minVal = min_element(unorderedPack.begin(), unorderedPack.end());
+                    int unorderedDiff = min(abs(index - *minVal), maxPacketCount - abs(index - *minVal));
+                    if(unorderedDiff > 5 || unorderedPack.size() >= 5) {
+                        for (auto it = unorderedPack.begin(); it != unorderedPack.end(); it++) {
+                            nack(*it);
+                        }
+                        unorderedPack.clear();
+                    }
+                }
+
+                if((prevIndex + 1) % maxPacketCount != index && header.type == 0) {
+                    int diff = min(abs(index - prevIndex), maxPacketCount - abs(index - prevIndex));
+                    int smaller, bigger;
+                    if(compareSeqNum(prevIndex, index) < 0) {
+                        smaller = prevIndex;
+                        bigger = index;
+                    } else {
+                        smaller = index;
+                        bigger = prevIndex;
+                    }
+                    LOG_INFO("Packets Dropped: {} Index: {} Prev: {}", diff - 1, smaller, bigger);
+                    stats.packetsLost(diff - 1);
+                    if (diff < 5) {
+                        for (int i = smaller + 1; i < bigger; i = (i + 1) % (maxPacketCount)) {
+                            unorderedPack.push_back(i);
+                        }
+                    } else {
+                        for (int i = smaller + 1; i < bigger; i++) {
+                            nack(i);
+                        }
+                    }
+                }
+
+                if(header.type == 0) {
+                    buf[index].type = FRAME;
+                    prevIndex = index;
+                } else if (header.type == 1){
+                    buf[index].type = FRAME;
+                } else if(header.type == 3) {
+                    buf[index].type = INPUTRETRANSMIT;
+                    int sHigh, sLow, eHigh, eLow;
+                    sHigh = (uint8_t)buf[index].data[0];
+                    sLow = (uint8_t)buf[index].data[1];
+                    eHigh = (uint8_t)buf[index].data[2];
+                    eLow = (uint8_t)buf[index].data[3];
+                    if (sHigh < 60 && eHigh < 60) {
+                        int beginning = sHigh * maxByteVal + sLow;
+                        int end = eHigh * maxByteVal + eLow;
+                        LOG_DEBUG("Retransmit {} {}", beginning, end);
+                        for (int i = beginning; i < end; i = (i + 1) % maxPacketCount) {
+                            if(inputRetransmit) {
+                                inputRetransmit(i);
+                            }
+                        }
+                    }
+                } else if (header.type == 5) {
+                    buf[index].type = INPUTRETRANSMITIND;
+                    for(int i = 1; i < recvLen; i+=2) {
+                        if (i+1 < recvLen) {
+                            int seq = (int) ((recvData[i]) * maxByteVal + (recvData[i+1]));
+                            LOG_DEBUG("Retransmit {}", seq);
+                            if(seq < maxPacketCount && inputRetransmit) {
+                                inputRetransmit(seq);
+                            }
+                        }
+                    }
+                }
+            }
+
+            if(reorderStart) {
+                traceRecord("reorder", reorderStart, traceNow(), index);
+            }
+
+            drain();
+        }
+    }
+}
+
+chrono::milliseconds Receiver::resendNacks() {
+    lock_guard<mutex> guard(retransMutex);
+    chrono::milliseconds wait = rtt.rto(initialRto);
+    auto now = timeSource();
+    // keyframe data first, the rest of the stream is useless without it
+    for(bool keyframe : { true, false }) {
+        for(auto it = retransmits.begin(); it != retransmits.end(); it++) {
+            retransmitRequest& req = it->second;
+            if(req.keyframe != keyframe) {
+                continue;
+            }
+            if(req.due <= now) {
+                LOG_DEBUG("Timer expired for {}", it->first);
+                if(hopeless(req, now)) {
+                    suppressed++;
+                } else if(sendControl) {
+                    sendControl(req.data);
+                }
+                req.attempts++;
+                req.due = now + rtt.rto(initialRto) * (1 << min(req.attempts, maxBackoff));
+            }
+            wait = min(wait, max(chrono::milliseconds(1), chrono::duration_cast<chrono::milliseconds>(req.due - now)));
+        }
+    }
+    if(!pendingAcks.empty()) {
+        if(ackDue <= now) {
+            flushAcks();
+        } else {
+            wait = min(wait, max(chrono::milliseconds(1), chrono::duration_cast<chrono::milliseconds>(ackDue - now)));
+        }
+    }
+    return wait;
+}
+
+void Receiver::socketDrops(uint32_t total) {
+    if(total == lastSocketDrops) {
+        return;
+    }
+    uint32_t count = total - lastSocketDrops;
+    lastSocketDrops = total;
+    stats.kernelDropped(count);
+    reportSocketDrops += count;
+    LOG_WARN("socket receive buffer overflowed, {} datagrams dropped", count);
+}
+
+chrono::microseconds Receiver::srtt() {
+    lock_guard<mutex> guard(retransMutex);
+    return rtt.srtt;
+}
+
+int Receiver::nacksOutstanding() {
+    lock_guard<mutex> guard(retransMutex);
+    return retransmits.size();
+}
+
+void Receiver::reset() {
+    packetPos = 0;
+    for(int i = 0; i < maxPacketCount; i++) {
+        buf[i].visited = -1;
+        buf[i].transmitRequested = false;
+        buf[i].nal = 0;
+        buf[i].frameStart = clock::time_point();
+        buf[i].firstNal = 0;
+    }
+    prevIndex = -1;
+    index = 0;
+    unorderedPack.clear();
+    retransMutex.lock();
+    retransmits.clear();
+    pendingAcks.clear();
+    ackDue = clock::time_point();
+    lastKeyframeRequest = clock::time_point();
+    rtt = RttEstimator();
+    retransMutex.unlock();
+    suppressed = 0;
+    latency.reset();
+    stats.reset();
+    bandwidth.reset();
+    haveSeq = false;
+    seqReceived = lastExpected = lastSeqReceived = 0;
+    lastDecoded = lastDecodeUs = lastPresented = lastPresentUs = 0;
+    lastSocketDrops = reportSocketDrops = 0;
+    lastReport = clock::time_point();
+}
@@ -0,0 +1,257 @@
+#include <cstring>
+
+#include <latency.h>
+#include <protocol.h>
+#include <reliableChannel.h>
+
+using namespace std;
+
+
+ReliableChannel::ReliableChannel(SendQueue& out, size_t ringBytes, int window, int redundancy)
+    : out(out), ring(ringBytes), entries(window), redundancy(redundancy) {
+}
+
+bool ReliableChannel::inFlight(int seq) const {
+    int dist = (seq - oldest + maxPacketCount) % maxPacketCount;
+    return dist < inflight;
+}
+
+bool ReliableChannel::send(const string& payload) {
+    if(payload.length() > (size_t)maxInputPayload) {
+        return false;
+    }
+    size_t len = payload.length();
+
+    lock_guard<mutex> guard(lock);
+    if(inflight >= (int)entries.size()) {
+        return false;
+    }
+
+    // payloads are stored contiguously, skipping the end of the ring if one does not fit there
+    size_t offset;
+    if(inflight == 0) {
+        head = tail = 0;
+    }
+    if(inflight == 0 || tail > head) {
+        if(tail + len <= ring.size()) {
+            offset = tail;
+        } else if(len <= head) {
+            offset = 0;
+        } else {
+            return false;
+        }
+    } else if(tail + len <= head) {
+        offset = tail;
+    } else {
+        return false;
+    }
+
+    memcpy(&ring[offset], payload.data(), len);
+    tail = offset + len;
+
+    int seq = next;
+    entry& e = entries[seq % entries.size()];
+    e.offset = offset;
+    e.len = len;
+    e.acked = false;
+    e.attempts = 0;
+    e.sent = clock::now();
+    e.due = e.sent + rtt.rto(initialRto);
+    next = (next + 1) % maxPacketCount;
+    inflight++;
+
+    transmitBundled(seq, &ring[offset], len, e.sent);
+    return true;
+}
+
+void ReliableChannel::sendUnreliable(const string& payload, clock::time_point eventTime) {
+    if(payload.length() > (size_t)maxInputPayload) {
+        return;
+    }
+    lock_guard<mutex> guard(lock);
+    transmitBundled(unnumberedRecord, (const uint8_t*)payload.data(), payload.length(), eventTime);
+}
+
+// datagrams are built stampHeader bytes into buffer so the stamp can go in front without a copy
+void ReliableChannel::emit(uint8_t* buffer, int len, clock::time_point eventTime) {
+    if(!stampInput) {
+        out.push(buffer + stampHeader, len);
+        return;
+    }
+    uint32_t stamp = latencyStamp(eventTime);
+    buffer[0] = STAMPED;
+    buffer[1] = stamp >> 24;
+    buffer[2] = stamp >> 16;
+    buffer[3] = stamp >> 8;
+    buffer[4] = stamp;
+    out.push(buffer, len + stampHeader);
+}
+
+static void writeRecord(uint8_t* datagram, int& pos, int seq, const uint8_t* payload, size_t len) {
+    datagram[pos++] = seq / maxByteVal;
+    datagram[pos++] = seq % maxByteVal;
+    datagram[pos++] = len / maxByteVal;
+    datagram[pos++] = len % maxByteVal;
+    memcpy(&datagram[pos], payload, len);
+    pos += len;
+}
+
+// callers hold lock
+// sends payload as seq, falling back to the plain packet types when there is nothing to repeat
+// or the peer does not take bundles
+void ReliableChannel::transmitBundled(int seq, const uint8_t* payload, size_t len, clock::time_point eventTime) {
+    uint8_t buffer[maxDatagramSize];
+    uint8_t* datagram = buffer + stampHeader;
+    int pos = 2;
+    int count = 0;
+    writeRecord(datagram, pos, seq, payload, len);
+    count++;
+
+    // newest unacknowledged messages are the ones most likely to still be missing
+    for(int i = inflight - 1; i >= 0 && bundleInput && count <= redundancy; i--) {
+        int other = (oldest + i) % maxPacketCount;
+        entry& e = entries[other % entries.size()];
+        if(e.acked || other == seq) {
+            continue;
+        }
+        if(pos + 4 + e.len > maxDatagramSize - stampHeader) {
+            break;
+        }
+        writeRecord(datagram, pos, other, &ring[e.offset], e.len);
+        count++;
+    }
+
+    if(count > 1) {
+        datagram[0] = BUNDLED;
+        datagram[1] = count;
+        emit(buffer, pos, eventTime);
+        return;
+    }
+
+    if(seq == unnumberedRecord) {
+        datagram[0] = UNNUMBERED;
+        memcpy(&datagram[1], payload, len);
+        datagram[1 + len] = '\0';
+        emit(buffer, len + 2, eventTime);
+    } else {
+        datagram[0] = NUMBERED;
+        datagram[1] = seq / maxByteVal;
+        datagram[2] = seq % maxByteVal;
+        memcpy(&datagram[3], payload, len);
+        datagram[3 + len] = '\0';
+        emit(buffer, len + 4, eventTime);
+    }
+}
+
+// callers hold lock, resends seq on its own
+void ReliableChannel::retransmitOne(int seq, clock::time_point now) {
+    entry& e = entries[seq % entries.size()];
+    uint8_t buffer[maxDatagramSize];
+    uint8_t* datagram = buffer + stampHeader;
+    datagram[0] = RETRANSMIT;
+    datagram[1] = seq / maxByteVal;
+    datagram[2] = seq % maxByteVal;
+    memcpy(&datagram[3], &ring[e.offset], e.len);
+    datagram[3 + e.len] = '\0';
+    emit(buffer, e.len + 4, e.sent);
+
+    e.attempts++;
+    e.due = now + rtt.rto(initialRto) * (1 << min(e.attempts, maxBackoff));
+}
+
+// callers hold lock
+void ReliableChannel::markAcked(int seq, clock::time_point now) {
+    entry& e = entries[seq % entries.size()];
+    if(e.acked) {
+        return;
+    }
+    e.acked = true;
+    // a resent message cannot tell which copy was acked, so only first transmissions are timed
+    if(e.attempts == 0) {
+        rtt.sample(chrono::duration_cast<chrono::microseconds>(now - e.sent));
+    }
+}
+
+// callers hold lock, drops acknowledged messages from the front of the window
+void ReliableChannel::advance() {
+    while(inflight > 0 && entries[oldest % entries.size()].acked) {
+        oldest = (oldest + 1) % maxPacketCount;
+        inflight--;
+    }
+    if(inflight > 0) {
+        head = entries[oldest % entries.size()].offset;
+    }
+}
+
+void ReliableChannel::ack(int seq) {
+    lock_guard<mutex> guard(lock);
+    if(inFlight(seq)) {
+        markAcked(seq, clock::now());
+        advance();
+    }
+}
+
+void ReliableChannel::ackCumulative(int nextExpected, uint32_t sack) {
+    lock_guard<mutex> guard(lock);
+    auto now = clock::now();
+    while(inflight > 0 && inFlight(nextExpected) && oldest != nextExpected) {
+        markAcked(oldest, now);
+        advance();
+    }
+    // nextExpected one past the newest message acknowledges the whole window
+    if(nextExpected == next) {
+        while(inflight > 0) {
+            markAcked(oldest, now);
+            advance();
+        }
+    }
+    for(int i = 0; i < 32; i++) {
+        if(sack & (1u << i)) {
+            int seq = (nextExpected + 1 + i) % maxPacketCount;
+            if(inFlight(seq)) {
+                markAcked(seq, now);
+            }
+        }
+    }
+    advance();
+}
+
+void ReliableChannel::retransmit(int seq) {
+    lock_guard<mutex> guard(lock);
+    if(inFlight(seq) && !entries[seq % entries.size()].acked) {
+        retransmitOne(seq, clock::now());
+    }
+}
+
+chrono::milliseconds ReliableChannel::resendDue() {
+    lock_guard<mutex> guard(lock);
+    auto now = clock::now();
+    // messages sent while the caller sleeps are first due after one timeout at the earliest
+    auto wait = rtt.rto(initialRto);
+    for(int i = 0; i < inflight; i++) {
+        int seq = (oldest + i) % maxPacketCount;
+        entry& e = entries[seq % entries.size()];
+        if(e.acked) {
+            continue;
+        }
+        if(e.due <= now) {
+            retransmitOne(seq, now);
+        }
+        auto left = chrono::duration_cast<chrono::milliseconds>(e.due - now);
+        wait = max(chrono::milliseconds(1), min(wait, left));
+    }
+    return wait;
+}
+
+void ReliableChannel::reset() {
+    lock_guard<mutex> guard(lock);
+    head = tail = 0;
+    oldest = next = 0;
+    inflight = 0;
+    rtt = RttEstimator();
+}
+
+chrono::microseconds ReliableChannel::srtt() {
+    lock_guard<mutex> guard(lock);
+    return rtt.srtt;
+}
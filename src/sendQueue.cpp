@@ -0,0 +1,127 @@
+#include <cstring>
+
+#include <log.h>
+#include <sendQueue.h>
+
+using namespace std;
+
+SendQueue::SendQueue(size_t capacity) {
+    size_t size = 1;
+    while(size < capacity) {
+        size <<= 1;
+    }
+    slots = make_unique<slot[]>(size);
+    for(size_t i = 0; i < size; i++) {
+        slots[i].sequence.store(i, memory_order_relaxed);
+    }
+    mask = size - 1;
+}
+
+SendQueue::~SendQueue() {
+    close();
+    if(ready) {
+        SDL_DestroySemaphore(ready);
+    }
+}
+
+bool SendQueue::push(const uint8_t* data, int len) {
+    if(len > maxDatagramSize || !running) {
+        dropped++;
+        return false;
+    }
+
+    // claim a slot, a slot is free once the consumer has advanced its sequence past pos
+    size_t pos = enqueuePos.load(memory_order_relaxed);
+    slot* s;
+    while(true) {
+        s = &slots[pos & mask];
+        size_t seq = s->sequence.load(memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if(diff == 0) {
+            if(enqueuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                break;
+            }
+        } else if(diff < 0) {
+            dropped++;
+            return false;
+        } else {
+            pos = enqueuePos.load(memory_order_relaxed);
+        }
+    }
+
+    memcpy(s->data, data, len);
+    s->len = len;
+    s->sequence.store(pos + 1, memory_order_release);
+    SDL_SemPost(ready);
+    return true;
+}
+
+SendQueue::slot* SendQueue::peek(size_t offset) {
+    size_t pos = dequeuePos + offset;
+    slot* s = &slots[pos & mask];
+    if(offset > mask || s->sequence.load(memory_order_acquire) != pos + 1) {
+        return NULL;
+    }
+    return s;
+}
+
+void SendQueue::release(int count) {
+    for(int i = 0; i < count; i++) {
+        slots[dequeuePos & mask].sequence.store(dequeuePos + mask + 1, memory_order_release);
+        dequeuePos++;
+    }
+}
+
+// consumer side only, callers make sure the sender thread is not running
+void SendQueue::discard() {
+    while(peek(0)) {
+        release(1);
+    }
+}
+
+void SendQueue::open(UdpSocket* socket) {
+    close();
+    if(!ready) {
+        ready = SDL_CreateSemaphore(0);
+    }
+    // datagrams pushed between close and open were meant for the previous peer
+    discard();
+    dropped = 0;
+    sock = socket;
+    running = true;
+    sender = thread(&SendQueue::sendLoop, this);
+}
+
+void SendQueue::close() {
+    if(!running) {
+        return;
+    }
+    running = false;
+    SDL_SemPost(ready);
+    sender.join();
+    discard();
+    sock = NULL;
+}
+
+void SendQueue::sendLoop() {
+    datagram batch[socketBatch];
+    while(running) {
+        SDL_SemWaitTimeout(ready, 100);
+        while(running) {
+            int count = 0;
+            slot* s;
+            while(count < socketBatch && (s = peek(count)) != NULL) {
+                batch[count] = { s->data, maxDatagramSize, s->len };
+                count++;
+            }
+            if(count == 0) {
+                break;
+            }
+            int sent = sock->sendBatch(batch, count);
+            if(sent < count) {
+                LOG_WARN("{} of {} datagrams not sent", count - sent, count);
+            }
+            release(count);
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#include <cmath>
+
+#include <stats.h>
+
+using namespace std;
+
+void SessionStats::packetReceived(int len, clock::time_point arrival) {
+    bytes += len;
+    packets++;
+    windowBytes += len;
+    windowPackets++;
+
+    // RFC 3550 style smoothing over the change in arrival gap, the sender's spacing is unknown
+    if(lastArrival.time_since_epoch().count() != 0) {
+        double gapMs = chrono::duration<double, milli>(arrival - lastArrival).count();
+        if(lastGapMs >= 0) {
+            jitterMs += (fabs(gapMs - lastGapMs) - jitterMs) / 16;
+        }
+        lastGapMs = gapMs;
+    }
+    lastArrival = arrival;
+}
+
+void SessionStats::decoded(chrono::microseconds took) {
+    decodedFrames++;
+    decodeUs += took.count();
+    windowDecoded++;
+    windowDecodeUs += took.count();
+}
+
+void SessionStats::presented(chrono::microseconds took) {
+    frames++;
+    presentUs += took.count();
+    windowFrames++;
+    windowPresentUs += took.count();
+}
+
+void SessionStats::tick(clock::time_point now, int outstanding, chrono::microseconds rtt) {
+    if(windowStart.time_since_epoch().count() == 0) {
+        windowStart = now;
+        return;
+    }
+    auto elapsed = now - windowStart;
+    double seconds = chrono::duration<double>(elapsed).count();
+
+    bitrateMbps.push(windowBytes * 8 / seconds / 1e6);
+    estimateMbps.push(estimateBps / 1e6);
+    packetRate.push(windowPackets / seconds);
+    lossRate.push(windowLost / seconds);
+    kernelDropRate.push(windowKernelDrops / seconds);
+    recoveryRate.push(windowRecovered / seconds);
+    nacksOutstanding.push(outstanding);
+    rttMs.push(rtt.count() / 1000.0f);
+    jitter.push(jitterMs);
+    // frames dropped before presentation were decoded all the same
+    decodeMs.push(windowDecoded ? windowDecodeUs / windowDecoded / 1000 : 0);
+    presentMs.push(windowFrames ? windowPresentUs / windowFrames / 1000 : 0);
+    fps.push(windowFrames / seconds);
+
+    windowStart = now;
+    windowBytes = windowPackets = windowLost = windowKernelDrops = windowRecovered = windowFrames = windowDecoded = 0;
+    windowDecodeUs = windowPresentUs = 0;
+}
+
+void SessionStats::reset() {
+    *this = SessionStats();
+}
@@ -0,0 +1,68 @@
+#include <fstream>
+#include <iomanip>
+#include <memory>
+
+#include <trace.h>
+
+using namespace std;
+
+// about 20 seconds of a 60 fps session at every stage
+constexpr size_t traceRingSize = 1 << 16;
+
+struct traceEvent {
+    const char* name;
+    uint64_t startNs;
+    uint64_t endNs;
+    uint32_t id;
+    uint32_t tid;
+};
+
+atomic<bool> traceEnabled = true;
+
+static unique_ptr<traceEvent[]> events(new traceEvent[traceRingSize]());
+static atomic<uint64_t> written = 0;
+static atomic<uint32_t> threadCount = 0;
+static thread_local uint32_t traceTid = ++threadCount;
+static const auto traceEpoch = chrono::steady_clock::now();
+
+uint64_t traceNow() {
+    // never 0 so TraceSpan can use 0 for "not recording"
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - traceEpoch).count() + 1;
+}
+
+void traceRecord(const char* name, uint64_t startNs, uint64_t endNs, uint32_t id) {
+    uint64_t slot = written.fetch_add(1, memory_order_relaxed);
+    traceEvent& e = events[slot % traceRingSize];
+    e.name = name;
+    e.startNs = startNs;
+    e.endNs = endNs;
+    e.id = id;
+    e.tid = traceTid;
+}
+
+bool traceDump(const string& path) {
+    ofstream file(path);
+    if(!file) {
+        return false;
+    }
+    // spans still being written by other threads may come out torn, which is fine for a diagnostic dump
+    uint64_t end = written.load(memory_order_acquire);
+    uint64_t begin = end > traceRingSize ? end - traceRingSize : 0;
+
+    file << fixed << setprecision(3);
+    file << "{\"traceEvents\":[\n";
+    bool first = true;
+    for(uint64_t i = begin; i < end; i++) {
+        const traceEvent& e = events[i % traceRingSize];
+        if(!e.name) {
+            continue;
+        }
+        file << (first ? "" : ",\n");
+        first = false;
+        file << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.tid
+             << ",\"ts\":" << e.startNs / 1000.0 << ",\"dur\":" << (e.endNs - e.startNs) / 1000.0
+             << ",\"args\":{\"id\":" << e.id << "}}";
+    }
+    file << "\n]}\n";
+    return (bool)file;
+}
@@ -0,0 +1,682 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+#ifdef __linux__
+#include <netdb.h>
+#include <netinet/udp.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+
+#include <log.h>
+#include <udpSocket.h>
+
+using namespace std;
+
+UdpSocket::~UdpSocket() {
+    close();
+}
+
+void UdpSocket::setPeer(const peerAddress& to) {
+    peer = to;
+}
+
+bool UdpSocket::send(const uint8_t* data, int len) {
+    datagram single = { (uint8_t*)data, len, len, {} };
+    return sendBatch(&single, 1) == 1;
+}
+
+int UdpSocket::receiveBatch(datagram* batch, int count) {
+    if(nextSegment == segments.size()) {
+        segments.clear();
+        nextSegment = 0;
+        receiveSegments();
+    }
+    int taken = min((size_t)count, segments.size() - nextSegment);
+    copy_n(segments.begin() + nextSegment, taken, batch);
+    nextSegment += taken;
+    return taken;
+}
+
+void UdpSocket::addSegments(uint8_t* data, int len, int segmentSize, chrono::steady_clock::time_point arrival) {
+    if(segmentSize <= 0) {
+        segmentSize = len;
+    }
+    // every segment but the last is segmentSize bytes
+    int offset = 0;
+    do {
+        int part = min(segmentSize, len - offset);
+        segments.push_back({ data + offset, part, part, arrival });
+        offset += part;
+    } while(offset < len);
+}
+
+#ifdef __linux__
+
+// room for the drop counter, the GRO segment size and the timestamp on a received datagram
+constexpr size_t controlSize = CMSG_SPACE(sizeof(uint32_t)) + CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(timespec));
+// UDP_SEGMENT limits, UDP_MAX_SEGMENTS and the largest IPv4 UDP payload
+constexpr int maxSegments = 64;
+constexpr int maxSegmentedSize = 65507;
+// stamps further back than this are taken for a CLOCK_REALTIME step, not a slow reader
+constexpr chrono::seconds maxStampAge(10);
+
+// kernel stamps are CLOCK_REALTIME, they move onto steady_clock by how long before realNow
+// they were taken. Datagrams without a usable stamp count as arriving at steadyNow.
+static chrono::steady_clock::time_point stampToSteady(const timespec& stamp, chrono::steady_clock::time_point steadyNow, const timespec& realNow) {
+    if(stamp.tv_sec == 0 && stamp.tv_nsec == 0) {
+        return steadyNow;
+    }
+    auto age = chrono::seconds(realNow.tv_sec - stamp.tv_sec) + chrono::nanoseconds(realNow.tv_nsec - stamp.tv_nsec);
+    if(age.count() < 0 || age > maxStampAge) {
+        return steadyNow;
+    }
+    return steadyNow - chrono::duration_cast<chrono::steady_clock::duration>(age);
+}
+
+#ifdef HAVE_LIBURING
+constexpr int uringEntries = 64;
+
+bool UdpSocket::openUring() {
+    if(io_uring_queue_init(uringEntries, &ring, 0) < 0) {
+        return false;
+    }
+    ringCount = groOn ? uringGroBuffers : uringBuffers;
+    // recvmsg header, address and control data go in front of the payload
+    ringBufferSize = slotSize + 128;
+    int ret;
+    bufRing = io_uring_setup_buf_ring(&ring, ringCount, 0, 0, &ret);
+    if(!bufRing) {
+        io_uring_queue_exit(&ring);
+        return false;
+    }
+    // left uninitialised, the kernel only touches the pages a datagram lands in
+    ringBuffers.reset(new uint8_t[(size_t)ringCount * ringBufferSize]);
+    int mask = io_uring_buf_ring_mask(ringCount);
+    for(int i = 0; i < ringCount; i++) {
+        io_uring_buf_ring_add(bufRing, &ringBuffers[(size_t)i * ringBufferSize], ringBufferSize, i, mask, i);
+    }
+    io_uring_buf_ring_advance(bufRing, ringCount);
+    ringMsg = {};
+    ringMsg.msg_namelen = sizeof(sockaddr_in);
+    ringMsg.msg_controllen = controlSize;
+    uring = true;
+    armReceive();
+    armTimer();
+    io_uring_submit(&ring);
+
+    // kernels without multishot recvmsg fail the request straight away
+    io_uring_cqe* cqe;
+    if(io_uring_peek_cqe(&ring, &cqe) == 0 && io_uring_cqe_get_data64(cqe) == SOCKET_READABLE && cqe->res == -EINVAL) {
+        closeUring();
+        return false;
+    }
+    return true;
+}
+
+void UdpSocket::closeUring() {
+    if(!uring) {
+        return;
+    }
+    io_uring_free_buf_ring(&ring, bufRing, ringCount, 0);
+    io_uring_queue_exit(&ring);
+    bufRing = NULL;
+    ringBuffers.reset();
+    held.clear();
+    uring = false;
+}
+
+void UdpSocket::armReceive() {
+    io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+    io_uring_prep_recvmsg_multishot(sqe, fd, &ringMsg, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    io_uring_sqe_set_data64(sqe, SOCKET_READABLE);
+}
+
+void UdpSocket::armTimer() {
+    io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+    io_uring_prep_poll_multishot(sqe, timerFd, POLLIN);
+    io_uring_sqe_set_data64(sqe, SOCKET_TIMER);
+}
+
+int UdpSocket::takeTimers() {
+    int events = 0;
+    bool rearm = false;
+    io_uring_cqe* cqe;
+    while(io_uring_peek_cqe(&ring, &cqe) == 0 && io_uring_cqe_get_data64(cqe) == SOCKET_TIMER) {
+        rearm |= !(cqe->flags & IORING_CQE_F_MORE);
+        io_uring_cqe_seen(&ring, cqe);
+        uint64_t expirations;
+        if(read(timerFd, &expirations, sizeof(expirations)) < 0) {
+            LOG_DEBUG("timerfd read: {}", strerror(errno));
+        }
+        events = SOCKET_TIMER;
+    }
+    if(rearm) {
+        armTimer();
+        io_uring_submit(&ring);
+    }
+    return events;
+}
+
+int UdpSocket::waitUring(chrono::milliseconds timeout) {
+    int events = takeTimers();
+    io_uring_cqe* cqe;
+    if(!events && io_uring_peek_cqe(&ring, &cqe) != 0) {
+        __kernel_timespec ts = { timeout.count() / 1000, timeout.count() % 1000 * 1000000 };
+        io_uring_wait_cqe_timeout(&ring, &cqe, &ts);
+        events |= takeTimers();
+    }
+    // whatever is left at the front is a datagram
+    if(io_uring_peek_cqe(&ring, &cqe) == 0) {
+        events |= SOCKET_READABLE;
+    }
+    return events;
+}
+
+void UdpSocket::receiveUring() {
+    // the segments handed out so far are done with
+    if(!held.empty()) {
+        int mask = io_uring_buf_ring_mask(ringCount);
+        for(size_t i = 0; i < held.size(); i++) {
+            io_uring_buf_ring_add(bufRing, &ringBuffers[(size_t)held[i] * ringBufferSize], ringBufferSize, held[i], mask, i);
+        }
+        io_uring_buf_ring_advance(bufRing, held.size());
+        held.clear();
+    }
+    int completions = 0;
+    bool rearmReceive = false, rearmTimer = false;
+    auto steadyNow = chrono::steady_clock::now();
+    timespec realNow;
+    clock_gettime(CLOCK_REALTIME, &realNow);
+    io_uring_cqe* cqe;
+    while(completions < socketBatch && io_uring_peek_cqe(&ring, &cqe) == 0) {
+        bool more = cqe->flags & IORING_CQE_F_MORE;
+        if(io_uring_cqe_get_data64(cqe) == SOCKET_TIMER) {
+            rearmTimer |= !more;
+            io_uring_cqe_seen(&ring, cqe);
+            uint64_t expirations;
+            if(read(timerFd, &expirations, sizeof(expirations)) < 0) {
+                LOG_DEBUG("timerfd read: {}", strerror(errno));
+            }
+            continue;
+        }
+        completions++;
+        rearmReceive |= !more;
+        // ENOBUFS means every buffer is handed out, the datagrams wait in the socket meanwhile
+        if(cqe->res < 0 && cqe->res != -ENOBUFS) {
+            LOG_WARN("io_uring recvmsg: {}", strerror(-cqe->res));
+        }
+        if(cqe->res >= 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+            uint16_t id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            held.push_back(id);
+            io_uring_recvmsg_out* out = io_uring_recvmsg_validate(&ringBuffers[(size_t)id * ringBufferSize], cqe->res, &ringMsg);
+            if(out && !(out->flags & MSG_TRUNC)) {
+                int segmentSize = 0;
+                timespec stamp = {};
+                for(cmsghdr* c = io_uring_recvmsg_cmsg_firsthdr(out, &ringMsg); c != NULL; c = io_uring_recvmsg_cmsg_nexthdr(out, &ringMsg, c)) {
+                    readControl(c, segmentSize, stamp);
+                }
+                addSegments((uint8_t*)io_uring_recvmsg_payload(out, &ringMsg), io_uring_recvmsg_payload_length(out, cqe->res, &ringMsg),
+                    segmentSize, stampToSteady(stamp, steadyNow, realNow));
+            }
+        }
+        io_uring_cqe_seen(&ring, cqe);
+    }
+    if(rearmReceive) {
+        armReceive();
+    }
+    if(rearmTimer) {
+        armTimer();
+    }
+    if(rearmReceive || rearmTimer) {
+        io_uring_submit(&ring);
+    }
+}
+#endif
+
+bool UdpSocket::open() {
+    close();
+    fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0) {
+        LOG_ERROR("socket: {}", strerror(errno));
+        return false;
+    }
+    sockaddr_in local = {};
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    local.sin_port = 0;
+    if(bind(fd, (sockaddr*)&local, sizeof(local)) < 0) {
+        LOG_ERROR("bind: {}", strerror(errno));
+        close();
+        return false;
+    }
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(epollFd < 0 || timerFd < 0) {
+        LOG_ERROR("epoll or timerfd: {}", strerror(errno));
+        close();
+        return false;
+    }
+    epoll_event readable = {};
+    readable.events = EPOLLIN;
+    readable.data.u32 = SOCKET_READABLE;
+    epoll_event timer = {};
+    timer.events = EPOLLIN;
+    timer.data.u32 = SOCKET_TIMER;
+    if(epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &readable) < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, timerFd, &timer) < 0) {
+        LOG_ERROR("epoll_ctl: {}", strerror(errno));
+        close();
+        return false;
+    }
+    groOn = gsoOn = false;
+    if(offload) {
+        int on = 1;
+        groOn = setsockopt(fd, SOL_UDP, UDP_GRO, &on, sizeof(on)) == 0;
+        // UDP_SEGMENT is asked for per message, setting a socket wide size of 0 only tells
+        // whether the kernel knows it
+        int none = 0;
+        gsoOn = setsockopt(fd, SOL_UDP, UDP_SEGMENT, &none, sizeof(none)) == 0;
+    }
+    slotSize = groOn ? maxGroSize : maxReceiveSize;
+    storage.reset(new uint8_t[(size_t)socketBatch * slotSize]);
+    segments.clear();
+    nextSegment = 0;
+    drops = 0;
+    if(preferUring) {
+#ifdef HAVE_LIBURING
+        if(!openUring()) {
+            LOG_WARN("io_uring with multishot recvmsg unavailable, receiving with epoll");
+        }
+#else
+        LOG_WARN("built without io_uring, receiving with epoll");
+#endif
+    }
+    return true;
+}
+
+void UdpSocket::close() {
+#ifdef HAVE_LIBURING
+    closeUring();
+#endif
+    for(int* owned : { &fd, &epollFd, &timerFd }) {
+        if(*owned >= 0) {
+            ::close(*owned);
+            *owned = -1;
+        }
+    }
+}
+
+bool UdpSocket::isOpen() const {
+    return fd >= 0;
+}
+
+const char* UdpSocket::backend() const {
+#ifdef HAVE_LIBURING
+    if(uring) {
+        return "io_uring";
+    }
+#endif
+    return "epoll";
+}
+
+bool UdpSocket::receiveCoalescing() const {
+    return groOn;
+}
+
+bool UdpSocket::sendSegmentation() const {
+    return gsoOn;
+}
+
+int UdpSocket::localPort() const {
+    sockaddr_in local;
+    socklen_t len = sizeof(local);
+    if(getsockname(fd, (sockaddr*)&local, &len) < 0) {
+        return -1;
+    }
+    return ntohs(local.sin_port);
+}
+
+bool UdpSocket::resolve(const char* host, int port, peerAddress& out) {
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo* found = NULL;
+    if(getaddrinfo(host, NULL, &hints, &found) != 0 || !found) {
+        return false;
+    }
+    out = *(sockaddr_in*)found->ai_addr;
+    out.sin_port = htons(port);
+    freeaddrinfo(found);
+    return true;
+}
+
+bool UdpSocket::sendTo(const uint8_t* data, int len, const peerAddress& to) {
+    return sendto(fd, data, len, 0, (const sockaddr*)&to, sizeof(to)) == len;
+}
+
+int UdpSocket::sendBatch(const datagram* batch, int count) {
+    mmsghdr msgs[socketBatch] = {};
+    iovec iovs[socketBatch];
+    alignas(cmsghdr) char control[socketBatch][CMSG_SPACE(sizeof(uint16_t))];
+    // datagrams in each message and the bytes they add up to
+    int carried[socketBatch];
+    int bytes[socketBatch];
+    count = min(count, socketBatch);
+    int messages = 0;
+    for(int i = 0; i < count; i++) {
+        iovs[i] = { batch[i].data, (size_t)batch[i].len };
+        // a run of equal sized datagrams, the last one maybe shorter, goes out as one
+        // message the kernel cuts up again
+        int m = messages - 1;
+        if(gsoOn && m >= 0 && batch[i].len > 0 && batch[i - 1].len == (int)iovs[i - carried[m]].iov_len &&
+                batch[i].len <= batch[i - 1].len && carried[m] < maxSegments && bytes[m] + batch[i].len <= maxSegmentedSize) {
+            msgs[m].msg_hdr.msg_iovlen++;
+            carried[m]++;
+            bytes[m] += batch[i].len;
+            continue;
+        }
+        m = messages++;
+        msgs[m].msg_hdr.msg_name = &peer;
+        msgs[m].msg_hdr.msg_namelen = sizeof(peer);
+        msgs[m].msg_hdr.msg_iov = &iovs[i];
+        msgs[m].msg_hdr.msg_iovlen = 1;
+        carried[m] = 1;
+        bytes[m] = batch[i].len;
+    }
+    for(int m = 0; m < messages; m++) {
+        if(carried[m] == 1) {
+            continue;
+        }
+        msgs[m].msg_hdr.msg_control = control[m];
+        msgs[m].msg_hdr.msg_controllen = sizeof(control[m]);
+        cmsghdr* c = CMSG_FIRSTHDR(&msgs[m].msg_hdr);
+        c->cmsg_level = SOL_UDP;
+        c->cmsg_type = UDP_SEGMENT;
+        c->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        uint16_t segmentSize = msgs[m].msg_hdr.msg_iov[0].iov_len;
+        memcpy(CMSG_DATA(c), &segmentSize, sizeof(segmentSize));
+    }
+    int sentMessages = 0, sent = 0;
+    while(sentMessages < messages) {
+        int n = sendmmsg(fd, msgs + sentMessages, messages - sentMessages, 0);
+        if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // the send buffer is full, wait for room like a blocking socket would
+            pollfd writable = { fd, POLLOUT, 0 };
+            if(poll(&writable, 1, 100) <= 0) {
+                break;
+            }
+            continue;
+        }
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            // routes through devices without checksum offload refuse segmented messages
+            if((errno == EIO || errno == EINVAL) && carried[sentMessages] > 1) {
+                LOG_WARN("UDP_SEGMENT refused ({}), sending datagrams one by one", strerror(errno));
+                gsoOn = false;
+                return sent + sendBatch(batch + sent, count - sent);
+            }
+            LOG_WARN("sendmmsg: {}", strerror(errno));
+            break;
+        }
+        for(int i = 0; i < n; i++) {
+            sent += carried[sentMessages + i];
+        }
+        sentMessages += n;
+    }
+    return sent;
+}
+
+void UdpSocket::readControl(const cmsghdr* c, int& segmentSize, timespec& stamp) {
+    if(c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_RXQ_OVFL) {
+        memcpy(&drops, CMSG_DATA(c), sizeof(drops));
+    } else if(c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_TIMESTAMPNS) {
+        memcpy(&stamp, CMSG_DATA(c), sizeof(stamp));
+    } else if(c->cmsg_level == SOL_UDP && c->cmsg_type == UDP_GRO) {
+        memcpy(&segmentSize, CMSG_DATA(c), sizeof(segmentSize));
+    }
+}
+
+void UdpSocket::receiveSegments() {
+#ifdef HAVE_LIBURING
+    if(uring) {
+        receiveUring();
+        return;
+    }
+#endif
+    mmsghdr msgs[socketBatch] = {};
+    iovec iovs[socketBatch];
+    alignas(cmsghdr) char control[socketBatch][controlSize];
+    for(int i = 0; i < socketBatch; i++) {
+        iovs[i] = { &storage[(size_t)i * slotSize], (size_t)slotSize };
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_control = control[i];
+        msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+    }
+    int received = recvmmsg(fd, msgs, socketBatch, MSG_DONTWAIT, NULL);
+    if(received < 0) {
+        if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            LOG_WARN("recvmmsg: {}", strerror(errno));
+        }
+        return;
+    }
+    auto steadyNow = chrono::steady_clock::now();
+    timespec realNow;
+    clock_gettime(CLOCK_REALTIME, &realNow);
+    for(int i = 0; i < received; i++) {
+        if(msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+            continue;
+        }
+        int segmentSize = 0;
+        timespec stamp = {};
+        for(cmsghdr* c = CMSG_FIRSTHDR(&msgs[i].msg_hdr); c != NULL; c = CMSG_NXTHDR(&msgs[i].msg_hdr, c)) {
+            readControl(c, segmentSize, stamp);
+        }
+        addSegments((uint8_t*)iovs[i].iov_base, msgs[i].msg_len, segmentSize, stampToSteady(stamp, steadyNow, realNow));
+    }
+}
+
+int UdpSocket::wait(chrono::milliseconds timeout) {
+    // segments of a GRO train are still to be handed out, only the timer is worth a look
+    int events = nextSegment < segments.size() ? SOCKET_READABLE : 0;
+    if(events) {
+        timeout = chrono::milliseconds(0);
+    }
+#ifdef HAVE_LIBURING
+    if(uring) {
+        return events | waitUring(timeout);
+    }
+#endif
+    epoll_event ready[2];
+    int count = epoll_wait(epollFd, ready, 2, timeout.count());
+    for(int i = 0; i < count; i++) {
+        events |= ready[i].data.u32;
+        if(ready[i].data.u32 == SOCKET_TIMER) {
+            uint64_t expirations;
+            if(read(timerFd, &expirations, sizeof(expirations)) < 0) {
+                LOG_DEBUG("timerfd read: {}", strerror(errno));
+            }
+        }
+    }
+    return events;
+}
+
+bool UdpSocket::setTimer(chrono::milliseconds interval) {
+    itimerspec spec = {};
+    spec.it_interval.tv_sec = interval.count() / 1000;
+    spec.it_interval.tv_nsec = interval.count() % 1000 * 1000000;
+    spec.it_value = spec.it_interval;
+    return timerfd_settime(timerFd, 0, &spec, NULL) == 0;
+}
+
+int UdpSocket::setReceiveBuffer(int bytes) {
+    // the kernel doubles the value for its bookkeeping and reports the doubled size back
+    int half = bytes / 2;
+    if(setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &half, sizeof(half)) < 0) {
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &half, sizeof(half));
+    }
+    int granted = 0;
+    socklen_t len = sizeof(granted);
+    getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &granted, &len);
+    return granted;
+}
+
+bool UdpSocket::enableDropCounter() {
+    int on = 1;
+    return setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) == 0;
+}
+
+bool UdpSocket::enableTimestamps() {
+    int on = 1;
+    return setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0;
+}
+
+#else
+
+bool UdpSocket::open() {
+    close();
+    if(SDLNet_Init() == -1) {
+        LOG_ERROR("SDLNet_Init: {}", SDLNet_GetError());
+        return false;
+    }
+    sock = SDLNet_UDP_Open(0);
+    set = SDLNet_AllocSocketSet(1);
+    sendPacket = SDLNet_AllocPacket(65536);
+    recvPacket = SDLNet_AllocPacket(maxReceiveSize);
+    storage = make_unique<uint8_t[]>(socketBatch * maxReceiveSize);
+    segments.clear();
+    nextSegment = 0;
+    if(!sock || !set || !sendPacket || !recvPacket) {
+        LOG_ERROR("SDLNet_UDP_Open: {}", SDLNet_GetError());
+        close();
+        return false;
+    }
+    SDLNet_UDP_AddSocket(set, sock);
+    drops = 0;
+    return true;
+}
+
+void UdpSocket::close() {
+    if(!sock && !set) {
+        return;
+    }
+    if(sock) {
+        SDLNet_UDP_Close(sock);
+        sock = NULL;
+    }
+    SDLNet_FreeSocketSet(set);
+    set = NULL;
+    SDLNet_FreePacket(sendPacket);
+    SDLNet_FreePacket(recvPacket);
+    sendPacket = recvPacket = NULL;
+    timerInterval = chrono::milliseconds(0);
+    SDLNet_Quit();
+}
+
+bool UdpSocket::isOpen() const {
+    return sock != NULL;
+}
+
+const char* UdpSocket::backend() const {
+    return "SDL_net";
+}
+
+bool UdpSocket::receiveCoalescing() const {
+    return false;
+}
+
+bool UdpSocket::sendSegmentation() const {
+    return false;
+}
+
+int UdpSocket::localPort() const {
+    IPaddress* local = SDLNet_UDP_GetPeerAddress(sock, -1);
+    return local ? SDLNet_Read16(&local->port) : -1;
+}
+
+bool UdpSocket::resolve(const char* host, int port, peerAddress& out) {
+    return SDLNet_ResolveHost(&out, host, (uint16_t)port) == 0;
+}
+
+bool UdpSocket::sendTo(const uint8_t* data, int len, const peerAddress& to) {
+    if(len > sendPacket->maxlen) {
+        return false;
+    }
+    memcpy(sendPacket->data, data, len);
+    sendPacket->len = len;
+    sendPacket->address = to;
+    return SDLNet_UDP_Send(sock, -1, sendPacket) != 0;
+}
+
+int UdpSocket::sendBatch(const datagram* batch, int count) {
+    int sent = 0;
+    for(int i = 0; i < count; i++) {
+        if(sendTo(batch[i].data, batch[i].len, peer)) {
+            sent++;
+        } else {
+            LOG_WARN("SDLNet_UDP_Send: {}", SDLNet_GetError());
+        }
+    }
+    return sent;
+}
+
+void UdpSocket::receiveSegments() {
+    auto now = chrono::steady_clock::now();
+    int received = 0;
+    while(received < socketBatch && SDLNet_UDP_Recv(sock, recvPacket) > 0) {
+        uint8_t* data = &storage[received * maxReceiveSize];
+        memcpy(data, recvPacket->data, recvPacket->len);
+        addSegments(data, recvPacket->len, 0, now);
+        received++;
+    }
+}
+
+int UdpSocket::wait(chrono::milliseconds timeout) {
+    auto now = chrono::steady_clock::now();
+    // datagrams of the last receive a smaller batch left behind
+    int events = nextSegment < segments.size() ? SOCKET_READABLE : 0;
+    if(events) {
+        timeout = chrono::milliseconds(0);
+    }
+    if(timerInterval.count() > 0) {
+        timeout = min(timeout, max(chrono::milliseconds(0), chrono::duration_cast<chrono::milliseconds>(timerDue - now)));
+    }
+    if(SDLNet_CheckSockets(set, timeout.count()) > 0) {
+        events |= SOCKET_READABLE;
+    }
+    if(timerInterval.count() > 0 && chrono::steady_clock::now() >= timerDue) {
+        timerDue += timerInterval;
+        events |= SOCKET_TIMER;
+    }
+    return events;
+}
+
+bool UdpSocket::setTimer(chrono::milliseconds interval) {
+    timerInterval = interval;
+    timerDue = chrono::steady_clock::now() + interval;
+    return true;
+}
+
+int UdpSocket::setReceiveBuffer(int) {
+    return 0;
+}
+
+bool UdpSocket::enableDropCounter() {
+    return false;
+}
+
+bool UdpSocket::enableTimestamps() {
+    return false;
+}
+
+#endif
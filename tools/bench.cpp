@@ -0,0 +1,357 @@
+// Microbenchmarks for the receive path primitives. Every case reports the cost per
+// operation, so reworking one of them shows up as a number that moved. The receiver
+// cases push pre-encrypted frame packets through Receiver::receive under different
+// loss patterns, which covers sequencing, gap detection and the NACK bookkeeping, and
+// time Receiver::resendNacks walking the losses such a stream leaves outstanding.
+// The socket cases take datagrams off a loopback stream through each receive backend,
+// with and without UDP_GRO/UDP_SEGMENT offload.
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <crypto.h>
+#include <log.h>
+#include <perf.h>
+#include <protocol.h>
+#include <receiver.h>
+#include <udpSocket.h>
+
+using namespace std;
+
+struct options {
+    // substring of the case names to run, empty runs all
+    string filter;
+    int packets = 200000;
+    // hardware counters per operation as well
+    bool perf = false;
+};
+
+options opts;
+
+// keeps the compiler from dropping a result
+template<typename T>
+static void keep(const T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+// calls fn(i) with i counting up from 0, untimed for the first tenth of count to warm
+// caches and allocators, then times count calls and prints the time per call
+template<typename F>
+static void bench(const string& name, int count, F fn) {
+    if(!opts.filter.empty() && name.find(opts.filter) == string::npos) {
+        return;
+    }
+    int warm = count / 10;
+    for(int i = 0; i < warm; i++) {
+        fn(i);
+    }
+    perfCounts begin = perfRead();
+    auto start = chrono::steady_clock::now();
+    for(int i = warm; i < warm + count; i++) {
+        fn(i);
+    }
+    double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+    perfCounts end = perfRead();
+    cout.width(36);
+    cout << left << name << ns / count << " ns/op" << endl;
+    if(perfActive()) {
+        cout << "    " << perfFormat(begin, end, count) << endl;
+    }
+}
+
+// marks an arrival as the numbered retransmission of a lost packet
+constexpr int retransmitted = 1 << 16;
+// lost packets come back this many packets later, about one round trip at a few thousand packets/s
+constexpr int recoveryDelay = 32;
+
+// sequence numbers in arrival order for a stream of count packets
+static vector<int> arrivalOrder(const string& pattern, int count, mt19937& rng) {
+    vector<int> order;
+    vector<pair<int, int>> recovering;
+    uniform_real_distribution<double> uniform(0.0, 1.0);
+    for(int i = 0; i < count; i++) {
+        int seq = i % maxPacketCount;
+        while(!recovering.empty() && recovering.front().first <= i) {
+            order.push_back(recovering.front().second | retransmitted);
+            recovering.erase(recovering.begin());
+        }
+        if((pattern == "random1" && uniform(rng) < 0.01) ||
+                (pattern == "burst8" && i % 1000 >= 500 && i % 1000 < 508)) {
+            recovering.push_back({ i + recoveryDelay, seq });
+            continue;
+        }
+        order.push_back(seq);
+    }
+    if(pattern == "reorder") {
+        // swap neighbours now and then, the common case on multipath links
+        for(size_t i = 1; i < order.size(); i += 50) {
+            swap(order[i - 1], order[i]);
+        }
+    }
+    return order;
+}
+
+// filler data NAL units, parsed but never turned into pictures
+static const string filler = string("\x00\x00\x00\x01\x0c", 5) + string(1018, '\xff') + '\x80';
+
+static vector<uint8_t> framePacket(EVP_CIPHER_CTX* en, int seq, const string& plain) {
+    int len = plain.size();
+    unsigned char* cipher = aes_encrypt(en, (unsigned char*)plain.data(), &len);
+    vector<uint8_t> datagram(len + 3);
+    datagram[0] = 0;
+    datagram[1] = seq / maxByteVal;
+    datagram[2] = seq % maxByteVal;
+    memcpy(&datagram[3], cipher, len);
+    delete[] cipher;
+    return datagram;
+}
+
+void benchSequence(mt19937& rng) {
+    vector<uint16_t> seqs(4096);
+    for(auto& seq : seqs) {
+        seq = rng() % maxPacketCount;
+    }
+    bench("compareSeqNum", opts.packets * 10, [&](int i) {
+        keep(compareSeqNum(seqs[i & 4095], seqs[(i + 1) & 4095]));
+    });
+}
+
+void benchHeaders(EVP_CIPHER_CTX* en) {
+    vector<vector<uint8_t>> datagrams;
+    string plain(1024, 'x');
+    for(int i = 0; i < 256; i++) {
+        datagrams.push_back(framePacket(en, i, plain));
+        // every few packets is something other than frame data
+        if(i % 16 == 0) {
+            datagrams.back()[0] = i % 32 == 0 ? INPUTACK : FRAMESTAMP;
+        }
+    }
+    bench("parseHeader", opts.packets * 10, [&](int i) {
+        const vector<uint8_t>& d = datagrams[i & 255];
+        datagramHeader header;
+        keep(parseHeader(d.data(), d.size(), header));
+        keep(header);
+    });
+}
+
+void benchDecrypt(EVP_CIPHER_CTX* en, EVP_CIPHER_CTX* de) {
+    for(int size : { 64, 1024 }) {
+        vector<uint8_t> datagram = framePacket(en, 0, string(size, 'x'));
+        bench("aes_decrypt " + to_string(size) + " B", opts.packets, [&](int) {
+            int len = datagram.size() - 3;
+            unsigned char* plain = aes_decrypt(de, &datagram[3], &len);
+            keep(plain[0]);
+            delete[] plain;
+        });
+    }
+}
+
+void benchSendBuilders() {
+    bench("encodeNack", opts.packets, [&](int i) {
+        keep(encodeNack(i % maxPacketCount));
+    });
+    vector<int> seqs;
+    long messages = 0;
+    bench("encodeAcks " + to_string(ackBatch), opts.packets / 10, [&](int i) {
+        // a full batch of retransmissions, out of order and spread over a few bitmaps
+        seqs.clear();
+        for(int j = 0; j < ackBatch; j++) {
+            seqs.push_back((i * 97 + j * 37 % 100) % maxPacketCount);
+        }
+        encodeAcks(seqs, [&](const string& msg) {
+            messages++;
+            keep(msg);
+        });
+    });
+    keep(messages);
+}
+
+void benchResendNacks(EVP_CIPHER_CTX* en, mt19937& rng) {
+    for(string pattern : { "random1", "burst8" }) {
+        // a few thousand packets whose retransmissions never arrive, so every loss stays outstanding
+        vector<int> order = arrivalOrder(pattern, 4000, rng);
+        Receiver receiver;
+        if(!receiver.init()) {
+            return;
+        }
+        receiver.playoutDelay = chrono::milliseconds(0);
+        auto now = chrono::steady_clock::now();
+        receiver.timeSource = [&] { return now; };
+        long nacks = 0;
+        receiver.sendControl = [&](const string&) { nacks++; };
+        for(int arrival : order) {
+            if(!(arrival & retransmitted)) {
+                vector<uint8_t> packet = framePacket(en, arrival, filler);
+                receiver.receive(packet.data(), packet.size(), now);
+            }
+        }
+        // every timer has run out by the next call, the longest backoff is under 10 s
+        string name = "resendNacks " + pattern + " " + to_string(receiver.nacksOutstanding()) + " lost";
+        bench(name, opts.packets / 100, [&](int) {
+            now += chrono::seconds(10);
+            keep(receiver.resendNacks());
+        });
+        keep(nacks);
+    }
+}
+
+void benchReceiver(EVP_CIPHER_CTX* en, mt19937& rng) {
+    vector<vector<uint8_t>> packets, retransmissions;
+    for(int seq = 0; seq < maxPacketCount; seq++) {
+        packets.push_back(framePacket(en, seq, filler));
+        retransmissions.push_back(packets.back());
+        retransmissions.back()[0] = 1;
+    }
+    for(string pattern : { "none", "random1", "burst8", "reorder" }) {
+        // enough packets for the warm up and the timed run to form one continuous stream
+        vector<int> order = arrivalOrder(pattern, opts.packets + opts.packets / 5, rng);
+        Receiver receiver;
+        if(!receiver.init()) {
+            return;
+        }
+        long nacks = 0;
+        receiver.sendControl = [&](const string&) { nacks++; };
+        auto now = chrono::steady_clock::now();
+        bench("receive " + pattern, order.size() * 5 / 6, [&](int i) {
+            int arrival = order[i % order.size()];
+            const vector<uint8_t>& packet = (arrival & retransmitted) ?
+                retransmissions[arrival & ~retransmitted] : packets[arrival];
+            receiver.receive(packet.data(), packet.size(), now);
+        });
+        keep(nacks);
+    }
+}
+
+static double threadCpuNs() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// share of one core a 100 Mbps stream of 1027 byte datagrams would take at ns per datagram
+static double corePer100Mbps(double ns) {
+    return ns * 100e6 / (1027 * 8) / 1e9 * 100;
+}
+
+void benchSocket() {
+    for(bool uring : { false, true }) {
+        for(bool offload : { false, true }) {
+            UdpSocket rx;
+            rx.preferUring = uring;
+            rx.offload = offload;
+            if(!rx.open() || (uring && string(rx.backend()) != "io_uring")) {
+                continue;
+            }
+            rx.setReceiveBuffer(defaultReceiveBuffer);
+            UdpSocket tx;
+            tx.offload = offload;
+            peerAddress to;
+            if(!tx.open() || !UdpSocket::resolve("127.0.0.1", rx.localPort(), to)) {
+                return;
+            }
+            tx.setPeer(to);
+            // frame packet sized datagrams, sent until the timed run is over. The wall time
+            // is bounded by the sender, each thread's CPU time is what its side costs.
+            atomic<bool> stop(false);
+            long sent = 0;
+            double sendCpu = 0;
+            thread sender([&] {
+                vector<uint8_t> payload(1027, 'x');
+                datagram burst[socketBatch];
+                for(auto& d : burst) {
+                    d = { payload.data(), (int)payload.size(), (int)payload.size(), {} };
+                }
+                double start = threadCpuNs();
+                while(!stop) {
+                    sent += tx.sendBatch(burst, socketBatch);
+                }
+                sendCpu = threadCpuNs() - start;
+            });
+            datagram batch[socketBatch];
+            int taken = 0, count = 0;
+            long calls = 0;
+            // a sender that stopped getting through ends the case instead of hanging it
+            bool stalled = false;
+            auto lastData = chrono::steady_clock::now();
+            string name = string("socket receive ") + rx.backend() + (offload ? " offload" : "");
+            auto start = chrono::steady_clock::now();
+            double cpu = threadCpuNs();
+            bench(name, opts.packets, [&](int) {
+                while(taken == count && !stalled) {
+                    if(rx.wait(chrono::milliseconds(100)) & SOCKET_READABLE) {
+                        count = rx.receiveBatch(batch, socketBatch);
+                        taken = 0;
+                        calls++;
+                        lastData = chrono::steady_clock::now();
+                    } else if(chrono::steady_clock::now() - lastData > chrono::seconds(1)) {
+                        stalled = true;
+                    }
+                }
+                if(!stalled) {
+                    keep(batch[taken++].data[0]);
+                }
+            });
+            cpu = threadCpuNs() - cpu;
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            stop = true;
+            sender.join();
+            if(stalled) {
+                cout << "    no datagrams for a second, " << sent << " sent, result invalid" << endl;
+                continue;
+            }
+            int total = opts.packets + opts.packets / 10;
+            // with io_uring a receive call only enters the kernel when it has to re-arm
+            cout << "    receive " << cpu / total << " ns cpu/datagram (" << corePer100Mbps(cpu / total)
+                << "% core/100 Mbps), " << calls / seconds << " calls/s" << endl;
+            cout << "    send " << sendCpu / sent << " ns cpu/datagram (" << corePer100Mbps(sendCpu / sent)
+                << "% core/100 Mbps), GRO " << (rx.receiveCoalescing() ? "on" : "off")
+                << ", GSO " << (tx.sendSegmentation() ? "on" : "off") << endl;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    for(int i = 1; i + 1 < argc; i += 2) {
+        string arg = argv[i];
+        if(arg == "--filter") {
+            opts.filter = argv[i + 1];
+        } else if(arg == "--packets") {
+            opts.packets = stoi(argv[i + 1]);
+        } else if(arg == "--perf") {
+            opts.perf = stoi(argv[i + 1]) != 0;
+        }
+    }
+    if((argc - 1) % 2 != 0 || opts.packets <= 0) {
+        cout << "usage: bench [--filter name] [--packets 200000] [--perf 0|1]" << endl;
+        return 1;
+    }
+
+    EVP_CIPHER_CTX* en = EVP_CIPHER_CTX_new();
+    EVP_CIPHER_CTX* de = EVP_CIPHER_CTX_new();
+    string key_data = aesKeyData;
+    if (aes_init(key_data, key_data.length(), (unsigned char*)aesSalt, en, de)) {
+        cout << "Couldn't initialize AES cipher" << endl;
+        return 1;
+    }
+    mt19937 rng(1);
+    if(opts.perf && !perfStart()) {
+        cout << "perf counters unavailable, see /proc/sys/kernel/perf_event_paranoid" << endl;
+    }
+
+    benchSequence(rng);
+    benchHeaders(en);
+    benchDecrypt(en, de);
+    benchSendBuilders();
+    benchReceiver(en, rng);
+    benchResendNacks(en, rng);
+    benchSocket();
+
+    EVP_CIPHER_CTX_free(en);
+    EVP_CIPHER_CTX_free(de);
+}
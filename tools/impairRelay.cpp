@@ -0,0 +1,337 @@
+// Loopback UDP relay between the client and a server that impairs the traffic passing
+// through it: random and Gilbert-Elliott burst loss, reordering, duplication, delay
+// with jitter and a rate limit with a bounded queue. All randomness comes from one
+// seeded generator so a run can be repeated exactly.
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <queue>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+using relayClock = chrono::steady_clock;
+
+// impairments applied to one direction of the relay
+struct impairment {
+    double loss = 0;
+    // Gilbert-Elliott: chance per packet to enter and to leave the bad state, and the loss
+    // rate while in it
+    double burstEnter = 0;
+    double burstExit = 1;
+    double burstLoss = 1;
+    double reorder = 0;
+    // extra hold time of a reordered packet
+    double reorderMs = 10;
+    double duplicate = 0;
+    double delayMs = 0;
+    double jitterMs = 0;
+    // 0 is unlimited
+    double rateMbps = 0;
+    int queueBytes = 256 * 1024;
+};
+
+struct options {
+    int port = 3478;
+    string server = "127.0.0.1:3479";
+    // "down" impairs server to client only, "up" client to server only, "both" either way
+    string direction = "down";
+    impairment impair;
+    unsigned seed = 1;
+    int report = 5;
+};
+
+struct direction {
+    impairment impair;
+    bool enabled = false;
+    bool bad = false;
+    // when the rate limited link is next free
+    relayClock::time_point linkFree;
+    long forwarded = 0, lost = 0, burstLost = 0, queueDropped = 0, duplicated = 0, reordered = 0;
+};
+
+struct scheduled {
+    relayClock::time_point due;
+    // breaks ties so packets due at the same time keep their order
+    long order;
+    sockaddr_in to;
+    vector<uint8_t> data;
+    bool operator>(const scheduled& other) const {
+        return due != other.due ? due > other.due : order > other.order;
+    }
+};
+
+int sock;
+sockaddr_in server, client;
+bool haveClient = false;
+bool handshakeDone = false;
+mt19937_64 rng;
+uniform_real_distribution<double> uniform(0.0, 1.0);
+priority_queue<scheduled, vector<scheduled>, greater<scheduled>> pending;
+long order = 0;
+direction down, up;
+// datagrams sendto refused, the first error is printed
+long sendFailures = 0;
+
+static bool sameAddress(const sockaddr_in& a, const sockaddr_in& b) {
+    return a.sin_addr.s_addr == b.sin_addr.s_addr && a.sin_port == b.sin_port;
+}
+
+static bool chance(double p) {
+    return p > 0 && uniform(rng) < p;
+}
+
+static bool resolve(const string& hostPort, sockaddr_in& addr) {
+    size_t colon = hostPort.find(':');
+    if(colon == string::npos) {
+        return false;
+    }
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo* result;
+    if(getaddrinfo(hostPort.substr(0, colon).c_str(), hostPort.substr(colon + 1).c_str(), &hints, &result) != 0) {
+        return false;
+    }
+    addr = *(sockaddr_in*)result->ai_addr;
+    freeaddrinfo(result);
+    return true;
+}
+
+static void schedule(relayClock::time_point due, const sockaddr_in& to, const uint8_t* data, int len) {
+    scheduled s;
+    s.due = due;
+    s.order = order++;
+    s.to = to;
+    s.data.assign(data, data + len);
+    pending.push(move(s));
+}
+
+// decides the fate of one datagram and queues every copy that survives
+void impairAndSchedule(direction& dir, const sockaddr_in& to, const uint8_t* data, int len) {
+    auto now = relayClock::now();
+    if(!dir.enabled) {
+        schedule(now, to, data, len);
+        dir.forwarded++;
+        return;
+    }
+    const impairment& im = dir.impair;
+
+    if(dir.bad ? chance(im.burstExit) : chance(im.burstEnter)) {
+        dir.bad = !dir.bad;
+    }
+    if(dir.bad && chance(im.burstLoss)) {
+        dir.burstLost++;
+        return;
+    }
+    if(chance(im.loss)) {
+        dir.lost++;
+        return;
+    }
+
+    auto departure = now;
+    if(im.rateMbps > 0) {
+        auto backlog = dir.linkFree > now ? dir.linkFree - now : relayClock::duration::zero();
+        double backlogBytes = chrono::duration<double>(backlog).count() * im.rateMbps * 1e6 / 8;
+        if(backlogBytes + len > im.queueBytes) {
+            dir.queueDropped++;
+            return;
+        }
+        departure = max(now, dir.linkFree) +
+            chrono::duration_cast<relayClock::duration>(chrono::duration<double>(len * 8 / (im.rateMbps * 1e6)));
+        dir.linkFree = departure;
+    }
+
+    int copies = chance(im.duplicate) ? 2 : 1;
+    if(copies == 2) {
+        dir.duplicated++;
+    }
+    for(int i = 0; i < copies; i++) {
+        double delayMs = im.delayMs;
+        if(im.jitterMs > 0) {
+            delayMs = max(0.0, delayMs + (uniform(rng) * 2 - 1) * im.jitterMs);
+        }
+        if(chance(im.reorder)) {
+            delayMs += im.reorderMs;
+            dir.reordered++;
+        }
+        schedule(departure + chrono::duration_cast<relayClock::duration>(chrono::duration<double, milli>(delayMs)),
+                to, data, len);
+    }
+    dir.forwarded++;
+}
+
+// the handshake answer names the address the client should stream with, point it at
+// the relay so peer to peer mode still goes through it. Whatever follows the address's
+// NUL, the server's capabilities, is passed on as it is.
+void rewriteHandshake(const options& opts, uint8_t* data, int& len, int capacity) {
+    int addressLen = strnlen((char*)data, len);
+    if(memchr(data, ':', addressLen) == NULL) {
+        return;
+    }
+    string rest = addressLen < len ? string((char*)data + addressLen + 1, len - addressLen - 1) : "";
+    string answer = "127.0.0.1:" + to_string(opts.port) + '\0' + rest;
+    if((int)answer.length() > capacity) {
+        return;
+    }
+    memcpy(data, answer.data(), answer.length());
+    len = answer.length();
+}
+
+void receiveAll(const options& opts) {
+    uint8_t data[65536];
+    sockaddr_in from;
+    socklen_t fromLen = sizeof(from);
+    int len;
+    while((len = recvfrom(sock, data, sizeof(data), MSG_DONTWAIT, (sockaddr*)&from, &fromLen)) > 0) {
+        fromLen = sizeof(from);
+        if(sameAddress(from, server)) {
+            if(!haveClient) {
+                continue;
+            }
+            if(!handshakeDone) {
+                handshakeDone = true;
+                rewriteHandshake(opts, data, len, sizeof(data));
+                schedule(relayClock::now(), client, data, len);
+                continue;
+            }
+            impairAndSchedule(down, client, data, len);
+        } else {
+            if(!haveClient || !sameAddress(from, client)) {
+                client = from;
+                haveClient = true;
+                handshakeDone = false;
+                cout << "client " << inet_ntoa(from.sin_addr) << ":" << ntohs(from.sin_port) << endl;
+                // the handshake itself is never impaired
+                schedule(relayClock::now(), server, data, len);
+                continue;
+            }
+            impairAndSchedule(up, server, data, len);
+        }
+    }
+}
+
+void printStats(const char* name, const direction& dir) {
+    cout << name << ": " << dir.forwarded << " forwarded, " << dir.lost << " lost, "
+        << dir.burstLost << " lost in bursts, " << dir.queueDropped << " queue drops, "
+        << dir.duplicated << " duplicated, " << dir.reordered << " reordered" << endl;
+}
+
+int main(int argc, char** argv) {
+    options opts;
+    impairment& im = opts.impair;
+    // stoi and stod throw invalid_argument or out_of_range on values that are not numbers
+    bool parsed = true;
+    try {
+        for(int i = 1; i + 1 < argc; i += 2) {
+            string arg = argv[i];
+            string value = argv[i + 1];
+            if(arg == "--port") {
+                opts.port = stoi(value);
+            } else if(arg == "--server") {
+                opts.server = value;
+            } else if(arg == "--direction") {
+                opts.direction = value;
+            } else if(arg == "--seed") {
+                opts.seed = stoul(value);
+            } else if(arg == "--report") {
+                opts.report = stoi(value);
+            } else if(arg == "--loss") {
+                im.loss = stod(value);
+            } else if(arg == "--burst-enter") {
+                im.burstEnter = stod(value);
+            } else if(arg == "--burst-exit") {
+                im.burstExit = stod(value);
+            } else if(arg == "--burst-loss") {
+                im.burstLoss = stod(value);
+            } else if(arg == "--reorder") {
+                im.reorder = stod(value);
+            } else if(arg == "--reorder-ms") {
+                im.reorderMs = stod(value);
+            } else if(arg == "--duplicate") {
+                im.duplicate = stod(value);
+            } else if(arg == "--delay-ms") {
+                im.delayMs = stod(value);
+            } else if(arg == "--jitter-ms") {
+                im.jitterMs = stod(value);
+            } else if(arg == "--rate-mbps") {
+                im.rateMbps = stod(value);
+            } else if(arg == "--queue-kb") {
+                im.queueBytes = stoi(value) * 1024;
+            }
+        }
+    } catch(const logic_error&) {
+        parsed = false;
+    }
+    if(!parsed || (argc - 1) % 2 != 0 || !resolve(opts.server, server) ||
+            (opts.direction != "down" && opts.direction != "up" && opts.direction != "both")) {
+        cout << "usage: impairRelay [--port 3478] [--server 127.0.0.1:3479] [--direction down|up|both] [--seed 1]" << endl
+            << "    [--loss p] [--burst-enter p] [--burst-exit p] [--burst-loss p] [--reorder p] [--reorder-ms 10]" << endl
+            << "    [--duplicate p] [--delay-ms 0] [--jitter-ms 0] [--rate-mbps 0] [--queue-kb 256] [--report 5]" << endl;
+        return 1;
+    }
+    rng.seed(opts.seed);
+    down.impair = im;
+    up.impair = im;
+    down.enabled = opts.direction != "up";
+    up.enabled = opts.direction != "down";
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if(sock < 0) {
+        cout << "socket: " << strerror(errno) << endl;
+        return 1;
+    }
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(opts.port);
+    if(bind(sock, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        cout << "bind: " << strerror(errno) << endl;
+        return 1;
+    }
+    cout << "relaying :" << opts.port << " to " << opts.server << endl;
+
+    auto nextReport = relayClock::now() + chrono::seconds(opts.report);
+    while(true) {
+        int timeout = 100;
+        auto now = relayClock::now();
+        if(!pending.empty()) {
+            auto wait = chrono::duration_cast<chrono::milliseconds>(pending.top().due - now).count();
+            timeout = max(0, min(timeout, (int)wait));
+        }
+        pollfd pfd = { sock, POLLIN, 0 };
+        if(poll(&pfd, 1, timeout) > 0) {
+            receiveAll(opts);
+        }
+
+        now = relayClock::now();
+        while(!pending.empty() && pending.top().due <= now) {
+            const scheduled& s = pending.top();
+            if(sendto(sock, s.data.data(), s.data.size(), 0, (const sockaddr*)&s.to, sizeof(s.to)) < 0) {
+                if(sendFailures++ == 0) {
+                    cout << "sendto: " << strerror(errno) << endl;
+                }
+            }
+            pending.pop();
+        }
+
+        if(opts.report > 0 && now >= nextReport) {
+            printStats("down", down);
+            printStats("up", up);
+            if(sendFailures > 0) {
+                cout << sendFailures << " datagrams could not be sent" << endl;
+            }
+            nextReport = now + chrono::seconds(opts.report);
+        }
+    }
+}
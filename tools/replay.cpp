@@ -0,0 +1,186 @@
+// Feeds a packet capture through the client's receive path (sequencing, gap detection
+// and NACKs, reassembly and decoding) without a window or a socket. Runs as fast as
+// possible by default or at the original arrival times, and can write a checksum of
+// every decoded frame so two runs can be compared bit for bit. Timers run on the
+// captured arrival times in either mode, so two runs send the same NACKs and acks.
+// Acks and feedback use the formats the server advertised when the capture was taken,
+// --capabilities overrides that for captures that did not record it.
+// --check 1 fails the run unless frames were decoded and matched to the capture's
+// frame stamps, as recorded with the standin's --stamp-frames 1 and the client's --latency,
+// or if two frames in a row carry the same trace id.
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <capture.h>
+#include <log.h>
+#include <receiver.h>
+
+using namespace std;
+
+struct options {
+    string file;
+    // "fast" or "original"
+    string timing = "fast";
+    string checksums;
+    bool check = false;
+    // peerCapabilities, -1 takes them from the capture
+    int capabilities = -1;
+};
+
+// FNV-1a over the visible luma plane
+static uint64_t frameChecksum(const AVFrame* frame) {
+    uint64_t hash = 14695981039346656037ull;
+    for(int y = 0; y < frame->height; y++) {
+        const uint8_t* row = frame->data[0] + (size_t)y * frame->linesize[0];
+        for(int x = 0; x < frame->width; x++) {
+            hash ^= row[x];
+            hash *= 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+int main(int argc, char** argv) {
+    options opts;
+    for(int i = 1; i + 1 < argc; i += 2) {
+        string arg = argv[i];
+        if(arg == "--file") {
+            opts.file = argv[i + 1];
+        } else if(arg == "--timing") {
+            opts.timing = argv[i + 1];
+        } else if(arg == "--checksums") {
+            opts.checksums = argv[i + 1];
+        } else if(arg == "--check") {
+            opts.check = string(argv[i + 1]) != "0";
+        } else if(arg == "--capabilities") {
+            opts.capabilities = strtol(argv[i + 1], NULL, 10);
+        }
+    }
+    if((argc - 1) % 2 != 0 || opts.file.empty() || (opts.timing != "fast" && opts.timing != "original")) {
+        cout << "usage: replay --file capture.sscap [--timing fast|original] [--checksums frames.txt]" << endl
+            << "    [--check 0|1] [--capabilities bits]" << endl;
+        return 1;
+    }
+    bool realtime = opts.timing == "original";
+
+    logStart(stderr);
+    CaptureReader reader;
+    if(!reader.open(opts.file)) {
+        return 1;
+    }
+
+    ofstream sums;
+    if(!opts.checksums.empty()) {
+        sums.open(opts.checksums);
+    }
+
+    Receiver receiver;
+    if(!receiver.init()) {
+        return 1;
+    }
+    int capabilities = opts.capabilities >= 0 ? opts.capabilities : reader.capabilities();
+    if(capabilities < 0) {
+        cout << "the capture does not record the server's capabilities, replaying with the original formats" << endl;
+        capabilities = 0;
+    }
+    cout << "server capabilities " << capabilities << endl;
+    receiver.batchAcks = capabilities & BATCHEDACKS;
+    receiver.sendEstimates = capabilities & BANDWIDTHESTIMATES;
+    receiver.sendReports = capabilities & RECEIVERREPORTS;
+    receiver.requestKeyframes = capabilities & KEYFRAMEREQUESTS;
+    long frames = 0, nacks = 0, acks = 0, ackMessages = 0;
+    // frames whose trace id, the pts, is missing or the same as the frame before
+    long sharedIds = 0;
+    int64_t lastPts = AV_NOPTS_VALUE;
+    receiver.sendControl = [&](const string& msg) {
+        if(msg[0] == '7') {
+            nacks++;
+        } else if(msg[0] == 'a' && msg.size() >= 7) {
+            uint32_t bitmap = (uint32_t)(uint8_t)msg[3] << 24 | (uint32_t)(uint8_t)msg[4] << 16 |
+                (uint32_t)(uint8_t)msg[5] << 8 | (uint8_t)msg[6];
+            acks += 1 + __builtin_popcount(bitmap);
+            ackMessages++;
+        } else if(msg[0] == '9') {
+            acks++;
+            ackMessages++;
+        }
+    };
+    // the values are replay time minus capture time, only the count means anything
+    receiver.latency.enabled = true;
+    receiver.present = [&](AVFrame* frame) {
+        frames++;
+        if(frame->pts != AV_NOPTS_VALUE) {
+            receiver.latency.presented(frame->pts);
+        }
+        if(frame->pts == AV_NOPTS_VALUE || frame->pts == lastPts) {
+            sharedIds++;
+        }
+        lastPts = frame->pts;
+        if(sums.is_open()) {
+            sums << frame->pts << ' ' << hex << frameChecksum(frame) << dec << '\n';
+        }
+    };
+
+    auto replayNow = chrono::steady_clock::time_point();
+    receiver.timeSource = [&] { return replayNow; };
+
+    long datagrams = 0;
+    uint64_t ns = 0, firstNs = 0;
+    const uint8_t* data;
+    int len;
+    auto start = chrono::steady_clock::now();
+    while(reader.next(ns, data, len)) {
+        if(datagrams == 0) {
+            firstNs = ns;
+        }
+        // arrival times keep their original spacing in either mode so the stats see the real jitter
+        auto arrival = start + chrono::nanoseconds(ns - firstNs);
+        if(realtime) {
+            this_thread::sleep_until(arrival);
+        }
+        // NACK timers that ran out before this datagram fire first, as the client's retransmit thread would
+        replayNow = arrival;
+        receiver.resendNacks();
+        receiver.receive(data, len, arrival);
+        datagrams++;
+    }
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << datagrams << " datagrams, " << frames << " frames decoded" << endl;
+    cout << nacks << " NACKs sent, " << acks << " retransmissions acknowledged in " << ackMessages << " messages, "
+        << receiver.nacksOutstanding() << " still outstanding" << endl;
+    cout << receiver.stats.nacksSuppressed << " NACKs suppressed, " << receiver.stats.skipped
+        << " lost packets skipped, " << receiver.stats.keyframeRequests << " keyframes requested" << endl;
+    cout << receiver.latency.count() << " frames matched to a frame stamp, " << sharedIds
+        << " without a trace id of their own" << endl;
+    cout << "captured over " << (ns - firstNs) / 1e9 << " s, replayed in " << elapsed << " s ("
+        << (elapsed > 0 ? datagrams / elapsed : 0) << " datagrams/s)" << endl;
+    logStop();
+
+    if(opts.check) {
+        bool ok = true;
+        if(frames == 0) {
+            cout << "check failed: no frames decoded" << endl;
+            ok = false;
+        }
+        // frames only match stamps when their pts carries the sequence number they started at
+        if(receiver.latency.count() == 0) {
+            cout << "check failed: no latency samples" << endl;
+            ok = false;
+        }
+        // the decode and present spans of a frame are tied together by its pts
+        if(sharedIds > 0) {
+            cout << "check failed: " << sharedIds << " frames share a trace id with the frame before" << endl;
+            ok = false;
+        }
+        if(!ok) {
+            return 1;
+        }
+        cout << "check passed" << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,717 @@
+// Loopback stand-in for the streaming server. Answers the handshake, streams an
+// annex B H.264 file or a small generated H.264 stream as encrypted frame packets, answers frame
+// NACKs with numbered retransmissions until they are acked, acknowledges input and
+// asks for input messages it is missing. The latest input stamp is echoed ahead of
+// the next frame so input latency can be measured without the production server.
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <crypto.h>
+#include <latency.h>
+#include <protocol.h>
+
+using namespace std;
+
+// plaintext bytes per frame packet, leaves room for padding and the 3 byte header
+constexpr int chunkSize = 1024;
+// sent frame packets kept for retransmission, a bit over a second at high bitrates
+constexpr int historySize = 4096;
+// numbered retransmissions are repeated until acked, at most this often
+constexpr auto resendInterval = chrono::milliseconds(100);
+constexpr int maxResends = 5;
+// how long a gap in the input sequence may stay open before it is requested
+constexpr auto inputGapWait = chrono::milliseconds(30);
+// generated stream: picture size in macroblocks and frames per IDR picture
+constexpr int syntheticWidthMbs = 4;
+constexpr int syntheticHeightMbs = 4;
+constexpr int syntheticGop = 30;
+
+struct options {
+    int port = 3478;
+    // empty streams synthetic frames
+    string file;
+    int fps = 30;
+    // kbit/s, frames smaller than bitrate / fps are padded with filler data, 0 sends them as they are
+    int bitrate = 0;
+    // follow the client's bandwidth estimate, padding is capped to it
+    bool adapt = false;
+    string advertise = "127.0.0.1";
+    // peerCapabilities bits sent with the handshake answer, 0 answers like the original server
+    int capabilities = BUNDLEDINPUT | STAMPEDINPUT | BATCHEDACKS | BANDWIDTHESTIMATES | RECEIVERREPORTS |
+        KEYFRAMEREQUESTS;
+    // stamp frames with their own send time while no input stamp is waiting
+    bool stampFrames = false;
+};
+
+struct sentPacket {
+    int seq = -1;
+    vector<uint8_t> datagram;
+};
+
+struct pendingResend {
+    chrono::steady_clock::time_point due;
+    int attempts = 0;
+};
+
+EVP_CIPHER_CTX* en = EVP_CIPHER_CTX_new();
+EVP_CIPHER_CTX* de = EVP_CIPHER_CTX_new();
+
+int sock;
+sockaddr_in client;
+bool haveClient = false;
+int seq = 0;
+// position in the stream, both start over for every client
+size_t unit = 0;
+long sessionFrames = 0;
+// options.capabilities, control messages the client should not send are ignored
+int advertised = 0;
+bool havePendingStamp = false;
+uint32_t pendingStamp = 0;
+
+vector<sentPacket> history(historySize);
+// numbered retransmissions waiting for the client's ack
+map<int, pendingResend> unacked;
+
+// input sequence tracking
+bool haveInput = false;
+int nextInput = 0;
+// missing input sequence numbers and when they went missing
+map<int, chrono::steady_clock::time_point> missingInput;
+chrono::steady_clock::time_point lastInputRequest;
+
+// latest estimate from the client in kbit/s, 0 before the first one
+uint32_t estimateKbps = 0;
+// latest receiver report
+long reports = 0;
+int reportLossPercent = 0;
+uint32_t reportLost = 0;
+uint32_t reportJitterUs = 0;
+// dropped by the client's socket rather than the network
+long reportSocketDrops = 0;
+// the client gave up on keyframe data, the next frame sent is an IDR picture
+bool keyframeRequested = false;
+long keyframeRequests = 0;
+
+long framesSent = 0, packetsSent = 0, nacksReceived = 0, retransmitsSent = 0, inputReceived = 0, inputRequests = 0;
+
+static bool isVcl(int type) {
+    return type == 1 || type == 5;
+}
+
+// splits an annex B stream into access units, a new one starts at the first slice of a
+// picture (first_mb_in_slice == 0) or at a parameter set, SEI or delimiter following a slice
+vector<string> readAccessUnits(const string& path) {
+    ifstream in(path, ios::binary);
+    string stream((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    vector<string> units;
+
+    vector<size_t> starts;
+    for(size_t i = 0; i + 3 < stream.size(); i++) {
+        if(stream[i] == 0 && stream[i + 1] == 0 && stream[i + 2] == 1) {
+            size_t start = (i > 0 && stream[i - 1] == 0) ? i - 1 : i;
+            starts.push_back(start);
+            i += 2;
+        }
+    }
+
+    size_t auStart = 0;
+    bool sawVcl = false;
+    for(size_t start : starts) {
+        size_t header = start + (stream[start + 2] == 1 ? 3 : 4);
+        int type = stream[header] & 0x1f;
+        bool firstSlice = isVcl(type) && header + 1 < stream.size() && (stream[header + 1] & 0x80);
+        bool beginsUnit = (isVcl(type) && firstSlice) || type == 6 || type == 7 || type == 8 || type == 9;
+        if(sawVcl && beginsUnit) {
+            units.push_back(stream.substr(auStart, start - auStart));
+            auStart = start;
+            sawVcl = false;
+        }
+        if(isVcl(type)) {
+            sawVcl = true;
+        }
+    }
+    if(auStart < stream.size()) {
+        units.push_back(stream.substr(auStart));
+    }
+    return units;
+}
+
+// the first access unit from index from on that holds an IDR slice, from itself if none does
+size_t nextIdrUnit(const vector<string>& units, size_t from) {
+    for(size_t n = 0; n < units.size(); n++) {
+        size_t i = (from + n) % units.size();
+        const string& unit = units[i];
+        for(size_t pos = unit.find(string("\x00\x00\x01", 3)); pos != string::npos && pos + 3 < unit.size();
+                pos = unit.find(string("\x00\x00\x01", 3), pos + 3)) {
+            if((unit[pos + 3] & 0x1f) == 5) {
+                return i;
+            }
+        }
+    }
+    return from;
+}
+
+// padding: filler data NAL units (type 12), which decoders skip
+string fillerUnit(size_t size) {
+    string unit;
+    while(unit.size() < size) {
+        size_t len = min(size - unit.size(), (size_t)60000);
+        unit += string("\x00\x00\x00\x01\x0c", 5);
+        unit += string(max(len, (size_t)6) - 6, '\xff');
+        unit += '\x80';
+    }
+    return unit;
+}
+
+// writes the RBSP of the generated stream, most significant bit first
+struct bitWriter {
+    string bytes;
+    int used = 8;
+
+    void put(uint32_t value, int count) {
+        for(int i = count - 1; i >= 0; i--) {
+            if(used == 8) {
+                bytes += '\0';
+                used = 0;
+            }
+            bytes.back() |= ((value >> i) & 1) << (7 - used);
+            used++;
+        }
+    }
+    // unsigned exp-Golomb
+    void ue(uint32_t value) {
+        int len = 32 - __builtin_clz(value + 1);
+        put(0, len - 1);
+        put(value + 1, len);
+    }
+    void se(int32_t value) {
+        ue(value > 0 ? 2 * value - 1 : -2 * value);
+    }
+    void align() {
+        used = 8;
+    }
+    // rbsp_trailing_bits
+    void trailing() {
+        put(1, 1);
+        align();
+    }
+};
+
+// start code, header and the RBSP with emulation prevention bytes
+string nalUnit(uint8_t header, const string& rbsp) {
+    string nal("\x00\x00\x00\x01", 4);
+    nal += (char)header;
+    int zeros = 0;
+    for(char c : rbsp) {
+        if(zeros == 2 && (uint8_t)c <= 3) {
+            nal += '\x03';
+            zeros = 0;
+        }
+        nal += c;
+        zeros = c == 0 ? zeros + 1 : 0;
+    }
+    return nal;
+}
+
+// Baseline profile, picture order by decode order, one reference frame, no VUI
+string syntheticSps() {
+    bitWriter b;
+    b.put(66, 8);
+    b.put(0xc0, 8);
+    b.put(30, 8);
+    b.ue(0);
+    b.ue(0); // log2_max_frame_num_minus4
+    b.ue(2); // pic_order_cnt_type
+    b.ue(1); // max_num_ref_frames
+    b.put(0, 1);
+    b.ue(syntheticWidthMbs - 1);
+    b.ue(syntheticHeightMbs - 1);
+    b.put(1, 1); // frame_mbs_only_flag
+    b.put(1, 1); // direct_8x8_inference_flag
+    b.put(0, 1); // frame_cropping_flag
+    b.put(0, 1); // vui_parameters_present_flag
+    b.trailing();
+    return nalUnit(0x67, b.bytes);
+}
+
+// CAVLC, one slice group, everything else at its default
+string syntheticPps() {
+    bitWriter b;
+    b.ue(0);
+    b.ue(0);
+    b.put(0, 1); // entropy_coding_mode_flag
+    b.put(0, 1);
+    b.ue(0); // num_slice_groups_minus1
+    b.ue(0);
+    b.ue(0);
+    b.put(0, 1); // weighted_pred_flag
+    b.put(0, 2);
+    b.se(0); // pic_init_qp_minus26
+    b.se(0);
+    b.se(0);
+    b.put(0, 1); // deblocking_filter_control_present_flag
+    b.put(0, 1);
+    b.put(0, 1);
+    b.trailing();
+    return nalUnit(0x68, b.bytes);
+}
+
+// Generated source, so the client decodes real pictures without an encoded file. Every
+// syntheticGop frames an IDR picture of I_PCM macroblocks carries a gradient that moves
+// with each GOP, the frames between are P pictures with every macroblock skipped.
+string syntheticUnit(long frame) {
+    long picture = frame % syntheticGop;
+    bitWriter b;
+    b.ue(0); // first_mb_in_slice
+    if(picture == 0) {
+        b.ue(7); // I slice
+        b.ue(0);
+        b.put(0, 4); // frame_num
+        b.ue(frame / syntheticGop % 2); // idr_pic_id differs between neighbouring IDR pictures
+        b.put(0, 1); // no_output_of_prior_pics_flag
+        b.put(0, 1); // long_term_reference_flag
+        b.se(0); // slice_qp_delta
+        int shift = frame / syntheticGop * 8;
+        for(int mb = 0; mb < syntheticWidthMbs * syntheticHeightMbs; mb++) {
+            b.ue(25); // I_PCM
+            b.align();
+            int mbX = mb % syntheticWidthMbs, mbY = mb / syntheticWidthMbs;
+            for(int i = 0; i < 256; i++) {
+                int x = mbX * 16 + i % 16, y = mbY * 16 + i / 16;
+                b.put(16 + (x + y + shift) % 200, 8);
+            }
+            for(int i = 0; i < 128; i++) {
+                b.put(128, 8);
+            }
+        }
+        b.trailing();
+        return syntheticSps() + syntheticPps() + nalUnit(0x65, b.bytes);
+    }
+    b.ue(5); // P slice
+    b.ue(0);
+    b.put(picture % 16, 4); // frame_num
+    b.put(0, 1); // num_ref_idx_active_override_flag
+    b.put(0, 1); // ref_pic_list_modification_flag_l0
+    b.put(0, 1); // adaptive_ref_pic_marking_mode_flag
+    b.se(0);
+    b.ue(syntheticWidthMbs * syntheticHeightMbs); // mb_skip_run
+    b.trailing();
+    return nalUnit(0x41, b.bytes);
+}
+
+void sendTo(const uint8_t* data, int len) {
+    sendto(sock, data, len, 0, (sockaddr*)&client, sizeof(client));
+}
+
+void sendFrame(const string& unit) {
+    uint8_t datagram[maxByteVal * 8];
+    if(havePendingStamp) {
+        datagram[0] = FRAMESTAMP;
+        datagram[1] = seq / maxByteVal;
+        datagram[2] = seq % maxByteVal;
+        datagram[3] = pendingStamp >> 24;
+        datagram[4] = pendingStamp >> 16;
+        datagram[5] = pendingStamp >> 8;
+        datagram[6] = pendingStamp;
+        sendTo(datagram, 7);
+        havePendingStamp = false;
+    }
+    for(size_t pos = 0; pos < unit.size(); pos += chunkSize) {
+        int len = min((size_t)chunkSize, unit.size() - pos);
+        unsigned char* cipher = aes_encrypt(en, (unsigned char*)unit.data() + pos, &len);
+        datagram[0] = 0;
+        datagram[1] = seq / maxByteVal;
+        datagram[2] = seq % maxByteVal;
+        memcpy(&datagram[3], cipher, len);
+        delete[] cipher;
+        sendTo(datagram, len + 3);
+        sentPacket& sent = history[seq % historySize];
+        sent.seq = seq;
+        sent.datagram.assign(datagram, datagram + len + 3);
+        // a reused sequence number is a different packet now
+        unacked.erase(seq);
+        seq = (seq + 1) % maxPacketCount;
+        packetsSent++;
+    }
+    framesSent++;
+}
+
+// resends a frame packet as a numbered retransmission (type 1), which the client acks with 'a',
+// or with '9' when batched acks were not advertised
+void retransmitFrame(int frameSeq) {
+    const sentPacket& sent = history[frameSeq % historySize];
+    if(sent.seq != frameSeq) {
+        return;
+    }
+    vector<uint8_t> datagram = sent.datagram;
+    datagram[0] = 1;
+    sendTo(datagram.data(), datagram.size());
+    retransmitsSent++;
+}
+
+void handleControl(const uint8_t* data, int len) {
+    if(data[0] == 'b' && (advertised & BANDWIDTHESTIMATES) && len >= 5) {
+        uint32_t kbps = (uint32_t)data[1] << 24 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 8 | data[4];
+        if(kbps < estimateKbps * 9 / 10) {
+            cout << "estimate dropped to " << kbps << " kbit/s" << endl;
+        }
+        estimateKbps = kbps;
+        return;
+    }
+    if(data[0] == 'r' && (advertised & RECEIVERREPORTS) && len >= 21) {
+        reports++;
+        reportLossPercent = data[1] * 100 / 256;
+        reportLost = (uint32_t)data[2] << 16 | (uint32_t)data[3] << 8 | data[4];
+        reportJitterUs = (uint32_t)data[9] << 24 | (uint32_t)data[10] << 16 | (uint32_t)data[11] << 8 | data[12];
+        if(len >= 23) {
+            reportSocketDrops += data[21] << 8 | data[22];
+        }
+        return;
+    }
+    if(data[0] == 'a' && len >= 7) {
+        // base sequence number, then bit i of the bitmap acks base + 1 + i
+        int base = data[1] * maxByteVal + data[2];
+        uint32_t bitmap = (uint32_t)data[3] << 24 | (uint32_t)data[4] << 16 | (uint32_t)data[5] << 8 | data[6];
+        unacked.erase(base);
+        for(int i = 0; i < 32; i++) {
+            if(bitmap & (1u << i)) {
+                unacked.erase((base + 1 + i) % maxPacketCount);
+            }
+        }
+        return;
+    }
+    if(data[0] == 'k' && (advertised & KEYFRAMEREQUESTS)) {
+        keyframeRequested = true;
+        keyframeRequests++;
+        return;
+    }
+    if(len < 3) {
+        return;
+    }
+    int controlSeq = data[1] * maxByteVal + data[2];
+    if(controlSeq >= maxPacketCount) {
+        return;
+    }
+    if(data[0] == '7') {
+        nacksReceived++;
+        retransmitFrame(controlSeq);
+        pendingResend& resend = unacked[controlSeq];
+        resend.due = chrono::steady_clock::now() + resendInterval;
+        resend.attempts = 0;
+    } else if(data[0] == '9') {
+        unacked.erase(controlSeq);
+    }
+}
+
+// repeats numbered retransmissions the client has not acked yet
+void resendUnacked() {
+    auto now = chrono::steady_clock::now();
+    for(auto it = unacked.begin(); it != unacked.end();) {
+        if(it->second.due > now) {
+            it++;
+            continue;
+        }
+        if(++it->second.attempts > maxResends) {
+            it = unacked.erase(it);
+            continue;
+        }
+        retransmitFrame(it->first);
+        it->second.due = now + resendInterval;
+        it++;
+    }
+}
+
+// sends a range request (type 3) for input messages that stayed missing, it takes a frame
+// sequence number like any other frame packet
+void requestMissingInput() {
+    if(missingInput.empty()) {
+        return;
+    }
+    auto now = chrono::steady_clock::now();
+    // ask again later if the retransmissions get lost as well
+    if(now - lastInputRequest < resendInterval) {
+        return;
+    }
+    int first = -1, last = -1;
+    for(auto& missing : missingInput) {
+        if(now - missing.second < inputGapWait) {
+            continue;
+        }
+        if(first == -1 || compareSeqNum(missing.first, first) < 0) {
+            first = missing.first;
+        }
+        if(last == -1 || compareSeqNum(missing.first, last) > 0) {
+            last = missing.first;
+        }
+    }
+    if(first == -1) {
+        return;
+    }
+    uint8_t range[4] = { (uint8_t)(first / maxByteVal), (uint8_t)(first % maxByteVal),
+        (uint8_t)(((last + 1) % maxPacketCount) / maxByteVal), (uint8_t)(((last + 1) % maxPacketCount) % maxByteVal) };
+    int len = sizeof(range);
+    unsigned char* cipher = aes_encrypt(en, range, &len);
+    uint8_t datagram[64];
+    datagram[0] = 3;
+    datagram[1] = seq / maxByteVal;
+    datagram[2] = seq % maxByteVal;
+    memcpy(&datagram[3], cipher, len);
+    delete[] cipher;
+    sendTo(datagram, len + 3);
+    sentPacket& sent = history[seq % historySize];
+    sent.seq = seq;
+    sent.datagram.assign(datagram, datagram + len + 3);
+    seq = (seq + 1) % maxPacketCount;
+    inputRequests++;
+    lastInputRequest = now;
+}
+
+void inputReceivedSeq(int inputSeq) {
+    inputReceived++;
+    auto now = chrono::steady_clock::now();
+    if(!haveInput) {
+        haveInput = true;
+        nextInput = inputSeq;
+    }
+    if(compareSeqNum(inputSeq, nextInput) >= 0) {
+        for(int i = nextInput; i != inputSeq; i = (i + 1) % maxPacketCount) {
+            missingInput.emplace(i, now);
+        }
+        nextInput = (inputSeq + 1) % maxPacketCount;
+    } else {
+        missingInput.erase(inputSeq);
+    }
+}
+
+void ackInput(int inputSeq) {
+    uint8_t ack[3] = { INPUTACK, (uint8_t)(inputSeq / maxByteVal), (uint8_t)(inputSeq % maxByteVal) };
+    sendTo(ack, 3);
+}
+
+void handleInput(const uint8_t* data, int len) {
+    if(len >= stampHeader && data[0] == STAMPED) {
+        pendingStamp = (uint32_t)data[1] << 24 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 8 | data[4];
+        havePendingStamp = true;
+        data += stampHeader;
+        len -= stampHeader;
+    }
+    if(len < 1) {
+        return;
+    }
+    if((data[0] == NUMBERED || data[0] == RETRANSMIT) && len >= 3) {
+        int inputSeq = data[1] * maxByteVal + data[2];
+        ackInput(inputSeq);
+        inputReceivedSeq(inputSeq);
+    } else if(data[0] == UNNUMBERED && len >= 2) {
+        handleControl(data + 1, len - 1);
+    } else if(data[0] == BUNDLED && len >= 2) {
+        // records are newest first, walk them oldest first so redundant copies fill gaps
+        // instead of opening them
+        vector<int> records;
+        int pos = 2;
+        for(int i = 0; i < data[1] && pos + 4 <= len; i++) {
+            int recordSeq = data[pos] * maxByteVal + data[pos + 1];
+            int recordLen = data[pos + 2] * maxByteVal + data[pos + 3];
+            if(recordSeq != unnumberedRecord) {
+                ackInput(recordSeq);
+                records.push_back(recordSeq);
+            } else if(pos + 4 + recordLen <= len) {
+                handleControl(data + pos + 4, recordLen);
+            }
+            pos += 4 + recordLen;
+        }
+        for(auto it = records.rbegin(); it != records.rend(); it++) {
+            inputReceivedSeq(*it);
+        }
+    }
+}
+
+// forgets the previous client, the next one gets the stream from its start
+void resetSession() {
+    seq = 0;
+    unit = 0;
+    sessionFrames = 0;
+    for(sentPacket& sent : history) {
+        sent.seq = -1;
+    }
+    unacked.clear();
+    haveInput = false;
+    missingInput.clear();
+    havePendingStamp = false;
+    estimateKbps = 0;
+    keyframeRequested = false;
+}
+
+// handles everything the client sent since the last call, answering the handshake if needed
+void receiveInput(const options& opts) {
+    uint8_t data[2048];
+    sockaddr_in from;
+    socklen_t fromLen = sizeof(from);
+    int len;
+    while((len = recvfrom(sock, data, sizeof(data), MSG_DONTWAIT, (sockaddr*)&from, &fromLen)) > 0) {
+        // a reconnecting client comes from a new port, or sends the handshake again
+        bool newClient = !haveClient || from.sin_addr.s_addr != client.sin_addr.s_addr ||
+            from.sin_port != client.sin_port || (len == 2 && data[0] == '0');
+        fromLen = sizeof(from);
+        if(newClient) {
+            resetSession();
+            client = from;
+            haveClient = true;
+            string peer = opts.advertise + ":" + to_string(opts.port);
+            if(opts.capabilities) {
+                peer += '\0';
+                peer += (char)opts.capabilities;
+            }
+            sendTo((const uint8_t*)peer.data(), peer.length());
+            cout << "client connected from " << inet_ntoa(from.sin_addr) << ":" << ntohs(from.sin_port) << endl;
+            continue;
+        }
+        handleInput(data, len);
+    }
+}
+
+int main(int argc, char** argv) {
+    options opts;
+    // stoi throws invalid_argument or out_of_range on values that are not numbers
+    bool parsed = true;
+    try {
+        for(int i = 1; i + 1 < argc; i += 2) {
+            string arg = argv[i];
+            if(arg == "--port") {
+                opts.port = stoi(argv[i + 1]);
+            } else if(arg == "--file") {
+                opts.file = argv[i + 1];
+            } else if(arg == "--fps") {
+                opts.fps = stoi(argv[i + 1]);
+            } else if(arg == "--bitrate") {
+                opts.bitrate = stoi(argv[i + 1]);
+            } else if(arg == "--adapt") {
+                opts.adapt = stoi(argv[i + 1]) != 0;
+            } else if(arg == "--advertise") {
+                opts.advertise = argv[i + 1];
+            } else if(arg == "--capabilities") {
+                opts.capabilities = stoi(argv[i + 1]);
+            } else if(arg == "--stamp-frames") {
+                opts.stampFrames = stoi(argv[i + 1]) != 0;
+            }
+        }
+    } catch(const logic_error&) {
+        parsed = false;
+    }
+    if(!parsed || (argc - 1) % 2 != 0 || opts.fps <= 0 || opts.bitrate < 0) {
+        cout << "usage: standinServer [--file stream.h264] [--port 3478] [--fps 30] [--bitrate kbit/s] [--adapt 0|1] [--advertise 127.0.0.1]" << endl
+            << "    [--capabilities 63] [--stamp-frames 0|1]" << endl;
+        return 1;
+    }
+    advertised = opts.capabilities;
+
+    vector<string> units;
+    if(opts.file.empty()) {
+        cout << "streaming a generated " << syntheticWidthMbs * 16 << "x" << syntheticHeightMbs * 16 << " stream" << endl;
+    } else {
+        units = readAccessUnits(opts.file);
+        if(units.empty()) {
+            cout << "no H.264 access units in " << opts.file << endl;
+            return 1;
+        }
+        cout << units.size() << " access units loaded" << endl;
+    }
+
+    string key_data = aesKeyData;
+    if (aes_init(key_data, key_data.length(), (unsigned char*)aesSalt, en, de)) {
+        cout << "Couldn't initialize AES cipher" << endl;
+        return 1;
+    }
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if(sock < 0) {
+        cout << "socket: " << strerror(errno) << endl;
+        return 1;
+    }
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(opts.port);
+    if(bind(sock, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        cout << "bind: " << strerror(errno) << endl;
+        return 1;
+    }
+
+    auto interval = chrono::microseconds(1000000 / opts.fps);
+    auto next = chrono::steady_clock::now();
+    auto nextReport = next + chrono::seconds(5);
+    while(true) {
+        // input, NACKs and acks are handled as they arrive rather than once per frame
+        auto now = chrono::steady_clock::now();
+        int timeout = max(0, (int)min(chrono::duration_cast<chrono::milliseconds>(next - now).count(), (long)10));
+        pollfd pfd = { sock, POLLIN, 0 };
+        if(poll(&pfd, 1, timeout) > 0) {
+            receiveInput(opts);
+        }
+        if(!haveClient) {
+            next = chrono::steady_clock::now() + interval;
+            continue;
+        }
+        resendUnacked();
+        requestMissingInput();
+
+        now = chrono::steady_clock::now();
+        if(now >= next) {
+            int bitrate = opts.bitrate;
+            if(opts.adapt && estimateKbps > 0 && (bitrate == 0 || (int)estimateKbps < bitrate)) {
+                bitrate = estimateKbps;
+            }
+            size_t frameBytes = (size_t)bitrate * 1000 / 8 / opts.fps;
+            // the client's --latency then measures send to presentation, with no input needed
+            if(opts.stampFrames && !havePendingStamp) {
+                pendingStamp = latencyStamp(chrono::steady_clock::now());
+                havePendingStamp = true;
+            }
+            if(keyframeRequested) {
+                keyframeRequested = false;
+                if(opts.file.empty()) {
+                    // the generated stream starts its next GOP early
+                    sessionFrames = (sessionFrames + syntheticGop - 1) / syntheticGop * syntheticGop;
+                } else {
+                    unit = nextIdrUnit(units, unit);
+                }
+            }
+            string frame = opts.file.empty() ? syntheticUnit(sessionFrames) : units[unit];
+            if(frame.size() < frameBytes) {
+                sendFrame(frame + fillerUnit(max(frameBytes - frame.size(), (size_t)6)));
+            } else {
+                sendFrame(frame);
+            }
+            if(!units.empty()) {
+                unit = (unit + 1) % units.size();
+            }
+            sessionFrames++;
+            next += interval;
+        }
+        if(now >= nextReport) {
+            cout << framesSent << " frames, " << packetsSent << " packets, " << nacksReceived << " NACKs, "
+                << retransmitsSent << " retransmissions, " << unacked.size() << " unacked, "
+                << inputReceived << " input messages, " << inputRequests << " input requests, estimate "
+                << estimateKbps << " kbit/s, " << keyframeRequests << " keyframe requests" << endl;
+            cout << reports << " receiver reports, last: " << reportLossPercent << "% lost, " << reportLost
+                << " lost in total (" << reportSocketDrops << " by the client's socket), jitter "
+                << reportJitterUs << " us" << endl;
+            nextReport = now + chrono::seconds(5);
+        }
+    }
+}